@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# This file is part of libtocc-python. A Python wrapper for libtocc.
+# (see <http://www.github.com/aidin36/libtocc-python>)
+# Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+#
+# libtocc-python is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# libtocc-python is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Measures the per-call overhead of the most frequently called bindings.
+
+Each call does as little work as possible, so the time is mostly spent
+in argument unpacking and object creation. To compare two builds (e.g.
+the METH_VARARGS bindings with the METH_FASTCALL ones), run this with
+one build and `--save', then with the other and `--baseline':
+
+  PYTHONPATH=old/build call_overhead.py --save old.json
+  PYTHONPATH=new/build call_overhead.py --baseline old.json
+
+The built `manager', `file_info' and `query' modules should be on
+PYTHONPATH.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import sys
+import tempfile
+import timeit
+
+import file_info
+import manager
+import query
+
+
+def run_benchmarks(calls, repeat):
+    base_path = tempfile.mkdtemp(prefix="tocc-calls-")
+    try:
+        tocc_manager = manager.Manager(base_path)
+        tocc_manager.initialize()
+        source = os.path.join(base_path, "source")
+        with open(source, "wb") as source_file:
+            source_file.write(b"x")
+        imported = tocc_manager.import_file(source, title="title",
+                                            traditional_path="/bench/file",
+                                            tags=["bench"])
+        file_id = imported.get_id()
+        tag_query = query.Tag("bench")
+
+        cases = [
+            ("get_file_info(id)",
+             lambda: tocc_manager.get_file_info(file_id)),
+            ("get_file_info(file_id=id)",
+             lambda: tocc_manager.get_file_info(file_id=file_id)),
+            ("get_file_by_traditional_path",
+             lambda: tocc_manager.get_file_by_traditional_path("/bench/file")),
+            ("FileInfo(id)",
+             lambda: file_info.FileInfo(file_id)),
+            ("FileInfo.get_title()",
+             lambda: imported.get_title()),
+            ("query.Tag(str)",
+             lambda: query.Tag("bench")),
+            ("count(query)",
+             lambda: tocc_manager.count(tag_query)),
+        ]
+
+        results = {}
+        for name, function in cases:
+            try:
+                function()
+            except TypeError:
+                # e.g. keyword arguments, in a build that doesn't accept
+                # them.
+                print("%s: not supported by this build, skipped." % name)
+                continue
+            best = min(timeit.repeat(function, number=calls, repeat=repeat))
+            results[name] = best * 1e9 / calls
+        return results
+    finally:
+        shutil.rmtree(base_path, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--calls", type=int, default=200000,
+                        help="Number of calls in each measurement.")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="Number of measurements. The best one is used.")
+    parser.add_argument("--save", help="Saves the results to this JSON file.")
+    parser.add_argument("--baseline",
+                        help="JSON file saved by an earlier run to compare with.")
+    args = parser.parse_args()
+
+    results = run_benchmarks(args.calls, args.repeat)
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as baseline_file:
+            baseline = json.load(baseline_file)
+
+    print("%-30s %12s %12s %8s" % ("call", "ns/call", "baseline", "speedup"))
+    for name, nanoseconds in results.items():
+        if name in baseline:
+            print("%-30s %12.1f %12.1f %8.2f" %
+                  (name, nanoseconds, baseline[name],
+                   baseline[name] / nanoseconds))
+        else:
+            print("%-30s %12.1f %12s %8s" % (name, nanoseconds, "-", "-"))
+
+    if args.save:
+        with open(args.save, "w") as save_file:
+            json.dump(results, save_file, indent=2)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
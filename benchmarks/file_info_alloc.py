@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#
+# This file is part of libtocc-python. A Python wrapper for libtocc.
+# (see <http://www.github.com/aidin36/libtocc-python>)
+# Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+#
+# libtocc-python is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# libtocc-python is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Creates and drops a million FileInfo objects, and prints the time per
+object. FileInfo is stored inline in its Python object and deallocated
+objects are recycled, so this mostly measures that path.
+
+Two cases are measured:
+  - construct: FileInfo(file_id), dropped right away.
+  - search: Manager.search results (lists of FileInfo), dropped after
+    each call.
+
+To compare with another build (e.g. before a change), run this script
+with that build on PYTHONPATH and compare the numbers.
+
+Usage: file_info_alloc.py [--objects 1000000] [--page-size 1000]
+The built `manager', `file_info' and `query' modules should be on
+PYTHONPATH.
+"""
+
+import argparse
+import os
+import shutil
+import sys
+import tempfile
+import time
+
+import file_info
+import manager
+import query
+
+
+def measure_construct(object_count, file_id):
+    file_info_type = file_info.FileInfo
+    start = time.perf_counter()
+    for _ in range(object_count):
+        file_info_type(file_id)
+    return time.perf_counter() - start
+
+
+def measure_search(object_count, page_size):
+    base_path = tempfile.mkdtemp(prefix="tocc-alloc-")
+    try:
+        tocc_manager = manager.Manager(base_path)
+        tocc_manager.initialize()
+        source = os.path.join(base_path, "source")
+        with open(source, "wb") as source_file:
+            source_file.write(b"x")
+        for _ in range(page_size):
+            tocc_manager.import_file(source, tags=["bench"])
+
+        search_query = query.Tag("bench")
+        rounds = max(1, object_count // page_size)
+        start = time.perf_counter()
+        for _ in range(rounds):
+            # Results are dropped at the next iteration, so the objects
+            # are recycled.
+            list(tocc_manager.search(search_query))
+        return time.perf_counter() - start, rounds * page_size
+    finally:
+        shutil.rmtree(base_path, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--objects", type=int, default=1000000,
+                        help="Number of objects to create in each case.")
+    parser.add_argument("--page-size", type=int, default=1000,
+                        help="Number of files returned by each search.")
+    args = parser.parse_args()
+
+    elapsed = measure_construct(args.objects, "0000001")
+    print("construct: %d objects in %.3f s, %.1f ns per object" %
+          (args.objects, elapsed, elapsed * 1e9 / args.objects))
+
+    elapsed, object_count = measure_search(args.objects, args.page_size)
+    print("search:    %d objects in %.3f s, %.1f ns per object" %
+          (object_count, elapsed, elapsed * 1e9 / object_count))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
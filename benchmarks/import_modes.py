@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+#
+# This file is part of libtocc-python. A Python wrapper for libtocc.
+# (see <http://www.github.com/aidin36/libtocc-python>)
+# Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+#
+# libtocc-python is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# libtocc-python is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Compares the throughput of the import modes of Manager.import_file, on
+files from 1 KB to 4 GB.
+
+`copy' is the path libtocc itself takes (reading and writing the data
+through user space). The other modes transfer the data in the kernel
+(copy_file_range), share blocks (reflink) or don't copy at all
+(hardlink, move). Modes that the file system doesn't support fall back to
+a copy, so they're measured anyway.
+
+The base path and the source files are created in --directory, so both
+are on the same file system (which hardlink, reflink and move need). The
+largest size needs about three times of it as free space.
+
+Usage: import_modes.py [--sizes 1K,1M,64M,1G,4G] [--modes copy,...]
+                       [--repeat 3] [--directory DIR]
+The built `manager' and `file_info' modules should be on PYTHONPATH.
+"""
+
+import argparse
+import os
+import shutil
+import sys
+import tempfile
+import time
+
+import file_info  # noqa: F401 (manager needs its C API.)
+import manager
+
+
+ALL_MODES = ["copy", "copy_file_range", "reflink", "hardlink", "move"]
+
+SIZE_UNITS = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+
+
+def parse_size(text):
+    unit = text[-1].upper()
+    if unit in SIZE_UNITS:
+        return int(text[:-1]) * SIZE_UNITS[unit]
+    return int(text)
+
+
+def create_source(path, size):
+    chunk = os.urandom(min(size, 4 << 20))
+    with open(path, "wb") as source_file:
+        written = 0
+        while written < size:
+            part = chunk[:size - written]
+            source_file.write(part)
+            written += len(part)
+        source_file.flush()
+        os.fsync(source_file.fileno())
+
+
+def measure(tocc_manager, work_directory, source, mode):
+    """
+    Imports the source once with the mode, and returns the seconds it took.
+    """
+    if mode == "move":
+        # Move consumes its source, so each run moves a fresh link to it.
+        path = os.path.join(work_directory, "move-source")
+        os.link(source, path)
+    else:
+        path = source
+
+    start = time.perf_counter()
+    imported = tocc_manager.import_file(path, import_mode=mode)
+    elapsed = time.perf_counter() - start
+
+    tocc_manager.remove_file(imported.get_id())
+    return elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--sizes", default="1K,1M,64M,1G,4G",
+                        help="Comma separated sizes of the files (K, M, G).")
+    parser.add_argument("--modes", default=",".join(ALL_MODES),
+                        help="Comma separated import modes to measure.")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="Imports of each size and mode. The best is used.")
+    parser.add_argument("--directory", default=None,
+                        help="Where to create the files. Default is TMPDIR.")
+    args = parser.parse_args()
+
+    modes = args.modes.split(",")
+    work_directory = tempfile.mkdtemp(prefix="tocc-import-modes-",
+                                      dir=args.directory)
+    try:
+        base_path = os.path.join(work_directory, "base")
+        os.mkdir(base_path)
+        tocc_manager = manager.Manager(base_path)
+        tocc_manager.initialize()
+
+        print("%8s %16s %12s %12s" % ("size", "mode", "seconds", "MB/s"))
+        for size_text in args.sizes.split(","):
+            size = parse_size(size_text)
+            source = os.path.join(work_directory, "source")
+            create_source(source, size)
+
+            for mode in modes:
+                best = min(measure(tocc_manager, work_directory, source, mode)
+                           for _ in range(args.repeat))
+                print("%8s %16s %12.6f %12.1f" %
+                      (size_text, mode, best, size / best / (1 << 20)))
+
+            os.unlink(source)
+    finally:
+        shutil.rmtree(work_directory, ignore_errors=True)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
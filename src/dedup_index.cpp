@@ -0,0 +1,409 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dedup_index.h"
+#include "file_transfer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Size of the buffers used for reading files.
+   * It should be a multiple of the hash's stripe size.
+   */
+  static const size_t READ_BUFFER_SIZE = 1024 * 1024;
+
+  bool ContentHash::operator<(const ContentHash& other) const
+  {
+    if (this->hash != other.hash)
+    {
+      return this->hash < other.hash;
+    }
+    return this->size < other.size;
+  }
+
+  /*
+   * XXH64 hash of a stream of data.
+   *
+   * It's a small implementation of the public XXH64 algorithm, so no
+   * library is needed. It doesn't need to be cryptographic: duplicates
+   * are always compared byte by byte before they're used.
+   */
+  class Hasher
+  {
+  public:
+    Hasher()
+    {
+      this->lanes[0] = PRIME_1 + PRIME_2;
+      this->lanes[1] = PRIME_2;
+      this->lanes[2] = 0;
+      this->lanes[3] = -PRIME_1;
+      this->total_size = 0;
+      this->buffered_size = 0;
+    }
+
+    void update(const char* data, size_t size)
+    {
+      this->total_size += size;
+
+      // Filling the partial stripe of the previous update.
+      if (this->buffered_size > 0)
+      {
+        size_t needed = STRIPE_SIZE - this->buffered_size;
+        size_t copied = size < needed ? size : needed;
+        memcpy(this->buffer + this->buffered_size, data, copied);
+        this->buffered_size += copied;
+        data += copied;
+        size -= copied;
+        if (this->buffered_size < STRIPE_SIZE)
+        {
+          return;
+        }
+        process_stripe(this->buffer);
+        this->buffered_size = 0;
+      }
+
+      while (size >= STRIPE_SIZE)
+      {
+        process_stripe(data);
+        data += STRIPE_SIZE;
+        size -= STRIPE_SIZE;
+      }
+
+      memcpy(this->buffer, data, size);
+      this->buffered_size = size;
+    }
+
+    uint64_t get_size()
+    {
+      return this->total_size;
+    }
+
+    uint64_t digest()
+    {
+      uint64_t result;
+      if (this->total_size >= STRIPE_SIZE)
+      {
+        result = rotate_left(this->lanes[0], 1) + rotate_left(this->lanes[1], 7) +
+                 rotate_left(this->lanes[2], 12) + rotate_left(this->lanes[3], 18);
+        for (int i = 0; i < 4; i++)
+        {
+          result = (result ^ round(0, this->lanes[i])) * PRIME_1 + PRIME_4;
+        }
+      }
+      else
+      {
+        result = PRIME_5;
+      }
+      result += this->total_size;
+
+      const char* data = this->buffer;
+      size_t size = this->buffered_size;
+      while (size >= 8)
+      {
+        result ^= round(0, read_64(data));
+        result = rotate_left(result, 27) * PRIME_1 + PRIME_4;
+        data += 8;
+        size -= 8;
+      }
+      if (size >= 4)
+      {
+        result ^= (uint64_t)read_32(data) * PRIME_1;
+        result = rotate_left(result, 23) * PRIME_2 + PRIME_3;
+        data += 4;
+        size -= 4;
+      }
+      while (size > 0)
+      {
+        result ^= (uint64_t)(unsigned char)*data * PRIME_5;
+        result = rotate_left(result, 11) * PRIME_1;
+        data++;
+        size--;
+      }
+
+      result ^= result >> 33;
+      result *= PRIME_2;
+      result ^= result >> 29;
+      result *= PRIME_3;
+      result ^= result >> 32;
+      return result;
+    }
+
+  private:
+    static const uint64_t PRIME_1 = 11400714785074694791ULL;
+    static const uint64_t PRIME_2 = 14029467366897019727ULL;
+    static const uint64_t PRIME_3 = 1609587929392839161ULL;
+    static const uint64_t PRIME_4 = 9650029242287828579ULL;
+    static const uint64_t PRIME_5 = 2870177450012600261ULL;
+    static const size_t STRIPE_SIZE = 32;
+
+    static uint64_t rotate_left(uint64_t value, int bits)
+    {
+      return (value << bits) | (value >> (64 - bits));
+    }
+
+    static uint64_t round(uint64_t lane, uint64_t input)
+    {
+      lane += input * PRIME_2;
+      return rotate_left(lane, 31) * PRIME_1;
+    }
+
+    static uint64_t read_64(const char* data)
+    {
+      uint64_t value;
+      memcpy(&value, data, sizeof(value));
+      return value;
+    }
+
+    static uint32_t read_32(const char* data)
+    {
+      uint32_t value;
+      memcpy(&value, data, sizeof(value));
+      return value;
+    }
+
+    void process_stripe(const char* data)
+    {
+      // Lanes are independent, so the CPU runs them in parallel.
+      this->lanes[0] = round(this->lanes[0], read_64(data));
+      this->lanes[1] = round(this->lanes[1], read_64(data + 8));
+      this->lanes[2] = round(this->lanes[2], read_64(data + 16));
+      this->lanes[3] = round(this->lanes[3], read_64(data + 24));
+    }
+
+    uint64_t lanes[4];
+    uint64_t total_size;
+    char buffer[STRIPE_SIZE];
+    size_t buffered_size;
+  };
+
+  /*
+   * Reads as much as the buffer, unless the file ends.
+   *
+   * @return: Size of the read data, or -1 on error.
+   */
+  static ssize_t read_full(int fd, char* buffer, size_t size)
+  {
+    size_t read_size = 0;
+    while (read_size < size)
+    {
+      ssize_t result = read(fd, buffer + read_size, size - read_size);
+      if (result < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return -1;
+      }
+      if (result == 0)
+      {
+        break;
+      }
+      read_size += result;
+    }
+    return read_size;
+  }
+
+  ContentHash hash_file(const char* path)
+  {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+      throw FileTransferError(path, errno);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    Hasher hasher;
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    while (true)
+    {
+      ssize_t read_size = read_full(fd, &buffer[0], buffer.size());
+      if (read_size < 0)
+      {
+        int error_number = errno;
+        close(fd);
+        throw FileTransferError(path, error_number);
+      }
+      if (read_size == 0)
+      {
+        break;
+      }
+      hasher.update(&buffer[0], read_size);
+    }
+    close(fd);
+
+    ContentHash result;
+    result.hash = hasher.digest();
+    result.size = hasher.get_size();
+    return result;
+  }
+
+  ContentHash hash_data(const char* data, size_t size)
+  {
+    Hasher hasher;
+    hasher.update(data, size);
+
+    ContentHash result;
+    result.hash = hasher.digest();
+    result.size = hasher.get_size();
+    return result;
+  }
+
+  bool files_equal(const char* first_path, const char* second_path)
+  {
+    int first_fd = open(first_path, O_RDONLY);
+    if (first_fd < 0)
+    {
+      return false;
+    }
+    int second_fd = open(second_path, O_RDONLY);
+    if (second_fd < 0)
+    {
+      close(first_fd);
+      return false;
+    }
+
+    std::vector<char> first_buffer(READ_BUFFER_SIZE);
+    std::vector<char> second_buffer(READ_BUFFER_SIZE);
+    bool equal = true;
+    while (true)
+    {
+      ssize_t first_size = read_full(first_fd, &first_buffer[0], first_buffer.size());
+      ssize_t second_size = read_full(second_fd, &second_buffer[0], second_buffer.size());
+      if (first_size < 0 || first_size != second_size ||
+          memcmp(&first_buffer[0], &second_buffer[0], first_size) != 0)
+      {
+        equal = false;
+        break;
+      }
+      if (first_size == 0)
+      {
+        break;
+      }
+    }
+
+    close(first_fd);
+    close(second_fd);
+    return equal;
+  }
+
+  DedupIndex::DedupIndex(const std::string& index_path)
+  {
+    this->index_path = index_path;
+    this->loaded = false;
+  }
+
+  void DedupIndex::find(const ContentHash& content_hash,
+                        std::vector<std::string>& out_file_ids)
+  {
+    load();
+
+    std::pair<EntriesMap::iterator, EntriesMap::iterator> range =
+        this->entries.equal_range(content_hash);
+    for (EntriesMap::iterator iterator = range.first; iterator != range.second;
+         ++iterator)
+    {
+      out_file_ids.push_back(iterator->second);
+    }
+  }
+
+  void DedupIndex::add(const ContentHash& content_hash, const char* file_id)
+  {
+    load();
+
+    FILE* index_file = fopen(this->index_path.c_str(), "a");
+    if (index_file == NULL)
+    {
+      throw FileTransferError(this->index_path, errno);
+    }
+    int written = fprintf(index_file, "%016" PRIx64 " %" PRIu64 " %s\n",
+                          content_hash.hash, content_hash.size, file_id);
+    int error_number = errno;
+    if (fclose(index_file) != 0 && written >= 0)
+    {
+      written = -1;
+      error_number = errno;
+    }
+    if (written < 0)
+    {
+      throw FileTransferError(this->index_path, error_number);
+    }
+
+    this->entries.insert(EntriesMap::value_type(content_hash, file_id));
+  }
+
+  void DedupIndex::remove(const ContentHash& content_hash,
+                          const std::string& file_id)
+  {
+    std::pair<EntriesMap::iterator, EntriesMap::iterator> range =
+        this->entries.equal_range(content_hash);
+    for (EntriesMap::iterator iterator = range.first; iterator != range.second;
+         ++iterator)
+    {
+      if (iterator->second == file_id)
+      {
+        this->entries.erase(iterator);
+        return;
+      }
+    }
+  }
+
+  void DedupIndex::load()
+  {
+    if (this->loaded)
+    {
+      return;
+    }
+
+    FILE* index_file = fopen(this->index_path.c_str(), "r");
+    if (index_file == NULL)
+    {
+      if (errno == ENOENT)
+      {
+        // Nothing is imported with dedup yet.
+        this->loaded = true;
+        return;
+      }
+      throw FileTransferError(this->index_path, errno);
+    }
+
+    ContentHash content_hash;
+    char file_id[256];
+    while (fscanf(index_file, "%" SCNx64 " %" SCNu64 " %255s",
+                  &content_hash.hash, &content_hash.size, file_id) == 3)
+    {
+      this->entries.insert(EntriesMap::value_type(content_hash, file_id));
+    }
+    fclose(index_file);
+
+    this->loaded = true;
+  }
+
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_DEDUP_INDEX_H_INCLUDED
+#define LIBTOCC_PYTHON_DEDUP_INDEX_H_INCLUDED
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Hash of the contents of a file, and its size.
+   */
+  struct ContentHash
+  {
+    uint64_t hash;
+    uint64_t size;
+
+    bool operator<(const ContentHash& other) const;
+  };
+
+  /*
+   * Computes the hash of the file's contents (XXH64).
+   *
+   * @throw FileTransferError: if the file couldn't be read.
+   */
+  ContentHash hash_file(const char* path);
+
+  /*
+   * Computes the hash of the data in memory. It's the same as the hash of
+   * a file with the same contents.
+   */
+  ContentHash hash_data(const char* data, size_t size);
+
+  /*
+   * Checks if contents of the two files are the same.
+   * Returns false if any of them couldn't be read.
+   */
+  bool files_equal(const char* first_path, const char* second_path);
+
+  /*
+   * Finds the imported files that have the same contents as a new file.
+   *
+   * The index is an append-only file of `hash size file_id' lines. It's
+   * loaded on the first use. Entries of the removed files are kept until
+   * a lookup finds out they're removed.
+   *
+   * It doesn't touch any Python objects, so it can be used without the GIL.
+   */
+  class DedupIndex
+  {
+  public:
+    /*
+     * @param index_path: Path of the index file. It's created on the first
+     *   `add', if it doesn't exist.
+     */
+    DedupIndex(const std::string& index_path);
+
+    /*
+     * Returns IDs of the files that have the same hash.
+     *
+     * @throw FileTransferError: if the index couldn't be read.
+     */
+    void find(const ContentHash& content_hash,
+              std::vector<std::string>& out_file_ids);
+
+    /*
+     * Adds the file to the index.
+     *
+     * @throw FileTransferError: if the index couldn't be written.
+     */
+    void add(const ContentHash& content_hash, const char* file_id);
+
+    /*
+     * Removes the file from the index in memory, e.g. if it's found out
+     * that it's removed.
+     */
+    void remove(const ContentHash& content_hash, const std::string& file_id);
+
+  private:
+    typedef std::multimap<ContentHash, std::string> EntriesMap;
+
+    // Index is not copyable.
+    DedupIndex(const DedupIndex&);
+    DedupIndex& operator=(const DedupIndex&);
+
+    void load();
+
+    std::string index_path;
+    bool loaded;
+    EntriesMap entries;
+  };
+
+}
+
+#endif /* LIBTOCC_PYTHON_DEDUP_INDEX_H_INCLUDED */
@@ -0,0 +1,170 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "directory_walker.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+
+namespace libtocc_python
+{
+
+  DirectoryWalker::DirectoryWalker(const char* root, bool recursive)
+  {
+    this->root = root;
+    // "/a/b/" and "/a/b" are the same.
+    while (this->root.size() > 1 && this->root[this->root.size() - 1] == '/')
+    {
+      this->root.erase(this->root.size() - 1);
+    }
+    this->recursive = recursive;
+    this->started = false;
+    this->skipped = 0;
+  }
+
+  bool DirectoryWalker::next(std::string& out_relative_path)
+  {
+    if (!this->started)
+    {
+      this->started = true;
+      enter("");
+    }
+
+    while (!this->stack.empty())
+    {
+      Directory& directory = this->stack.back();
+      if (directory.position >= directory.entries.size())
+      {
+        this->stack.pop_back();
+        continue;
+      }
+
+      std::pair<std::string, unsigned char>& entry =
+          directory.entries[directory.position];
+      directory.position++;
+
+      std::string relative_path = directory.relative_path;
+      if (!relative_path.empty())
+      {
+        relative_path += '/';
+      }
+      relative_path += entry.first;
+
+      unsigned char type = get_type(relative_path, entry.second);
+      if (type == DT_REG)
+      {
+        out_relative_path.swap(relative_path);
+        return true;
+      }
+      if (type == DT_DIR)
+      {
+        if (this->recursive)
+        {
+          // Note that `directory' is invalid after this.
+          enter(relative_path);
+        }
+        continue;
+      }
+      if (type != DT_UNKNOWN)
+      {
+        this->skipped++;
+      }
+    }
+
+    return false;
+  }
+
+  std::string DirectoryWalker::get_full_path(const std::string& relative_path)
+  {
+    if (relative_path.empty())
+    {
+      return this->root;
+    }
+    if (this->root == "/")
+    {
+      return this->root + relative_path;
+    }
+    return this->root + '/' + relative_path;
+  }
+
+  std::vector<std::pair<std::string, std::string> >& DirectoryWalker::get_errors()
+  {
+    return this->errors;
+  }
+
+  unsigned long DirectoryWalker::get_skipped()
+  {
+    return this->skipped;
+  }
+
+  void DirectoryWalker::enter(const std::string& relative_path)
+  {
+    std::string full_path = get_full_path(relative_path);
+
+    DIR* dir = opendir(full_path.c_str());
+    if (dir == NULL)
+    {
+      this->errors.push_back(std::make_pair(full_path, std::string(strerror(errno))));
+      return;
+    }
+
+    this->stack.push_back(Directory());
+    Directory& directory = this->stack.back();
+    directory.relative_path = relative_path;
+    directory.position = 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      {
+        continue;
+      }
+      directory.entries.push_back(std::make_pair(std::string(entry->d_name),
+                                                 (unsigned char)entry->d_type));
+    }
+    closedir(dir);
+
+    std::sort(directory.entries.begin(), directory.entries.end());
+  }
+
+  unsigned char DirectoryWalker::get_type(const std::string& relative_path,
+                                          unsigned char reported_type)
+  {
+    if (reported_type != DT_UNKNOWN)
+    {
+      return reported_type;
+    }
+
+    std::string full_path = get_full_path(relative_path);
+    struct stat file_stat;
+    if (lstat(full_path.c_str(), &file_stat) != 0)
+    {
+      this->errors.push_back(std::make_pair(full_path, std::string(strerror(errno))));
+      return DT_UNKNOWN;
+    }
+
+    return IFTODT(file_stat.st_mode);
+  }
+
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_DIRECTORY_WALKER_H_INCLUDED
+#define LIBTOCC_PYTHON_DIRECTORY_WALKER_H_INCLUDED
+
+#include <dirent.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Finds the regular files of a directory tree, one by one, so the tree
+   * doesn't need to be listed in memory before its files are used.
+   *
+   * Entries of each directory are visited in order of their names.
+   * Symbolic links and special files are not followed; they're counted
+   * as skipped. Directories that can't be read are kept as errors, and
+   * walking continues.
+   *
+   * It doesn't touch any Python objects, so it can be used without the GIL.
+   */
+  class DirectoryWalker
+  {
+  public:
+    /*
+     * Nothing is read until the first call of `next'.
+     *
+     * @param root: Path of the directory to walk.
+     * @param recursive: If false, sub-directories are skipped.
+     */
+    DirectoryWalker(const char* root, bool recursive);
+
+    /*
+     * Finds the next file.
+     *
+     * @param out_relative_path: Path of the file, relative to the root.
+     *
+     * @return: false if there's no more files.
+     */
+    bool next(std::string& out_relative_path);
+
+    /*
+     * Returns full path of the file, from its relative path.
+     */
+    std::string get_full_path(const std::string& relative_path);
+
+    /*
+     * Paths that couldn't be read, and their error messages.
+     */
+    std::vector<std::pair<std::string, std::string> >& get_errors();
+
+    /*
+     * Number of the entries that aren't regular files or directories.
+     */
+    unsigned long get_skipped();
+
+  private:
+    struct Directory
+    {
+      // Relative to the root. Empty for the root itself.
+      std::string relative_path;
+      std::vector<std::pair<std::string, unsigned char> > entries;
+      size_t position;
+    };
+
+    // Walker is not copyable.
+    DirectoryWalker(const DirectoryWalker&);
+    DirectoryWalker& operator=(const DirectoryWalker&);
+
+    /*
+     * Reads entries of the directory, and pushes it to the stack.
+     */
+    void enter(const std::string& relative_path);
+
+    /*
+     * Returns type of the entry (DT_REG, DT_DIR, ...), using lstat if
+     * the file system didn't report it.
+     */
+    unsigned char get_type(const std::string& relative_path,
+                           unsigned char reported_type);
+
+    std::string root;
+    bool recursive;
+    bool started;
+    std::vector<Directory> stack;
+    std::vector<std::pair<std::string, std::string> > errors;
+    unsigned long skipped;
+  };
+
+}
+
+#endif /* LIBTOCC_PYTHON_DIRECTORY_WALKER_H_INCLUDED */
@@ -0,0 +1,213 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "edit_batch.h"
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Compares the tag edits that the pointers point to, so files can be
+   * grouped by their edits without copying them.
+   */
+  struct CompareTagEdits
+  {
+    bool operator()(const std::map<std::string, bool>* first,
+                    const std::map<std::string, bool>* second) const
+    {
+      return *first < *second;
+    }
+  };
+
+  EditBatch::EditBatch()
+  {
+    this->queued = 0;
+    this->coalesced = 0;
+    this->calls = 0;
+  }
+
+  void EditBatch::edit_tag(const char* file_id, const char* tag, bool assign)
+  {
+    FileEdits& file_edits = get_file_edits(file_id);
+    this->queued++;
+
+    std::pair<TagEditsMap::iterator, bool> inserted =
+        file_edits.tags.insert(TagEditsMap::value_type(tag, assign));
+    if (!inserted.second)
+    {
+      // Last edit of the tag wins.
+      inserted.first->second = assign;
+      this->coalesced++;
+    }
+  }
+
+  void EditBatch::set_title(const char* file_id, const char* title)
+  {
+    FileEdits& file_edits = get_file_edits(file_id);
+    this->queued++;
+
+    if (file_edits.has_title)
+    {
+      this->coalesced++;
+    }
+    file_edits.has_title = true;
+    file_edits.title = title;
+  }
+
+  bool EditBatch::is_empty()
+  {
+    return this->files.empty();
+  }
+
+  void EditBatch::merge(EditBatch& other)
+  {
+    FilesMap::iterator file_iterator = other.files.begin();
+    for (; file_iterator != other.files.end(); ++file_iterator)
+    {
+      const char* file_id = file_iterator->first.c_str();
+      FileEdits& file_edits = file_iterator->second;
+
+      TagEditsMap::iterator tag_iterator = file_edits.tags.begin();
+      for (; tag_iterator != file_edits.tags.end(); ++tag_iterator)
+      {
+        edit_tag(file_id, tag_iterator->first.c_str(), tag_iterator->second);
+      }
+      if (file_edits.has_title)
+      {
+        set_title(file_id, file_edits.title.c_str());
+      }
+    }
+  }
+
+  void EditBatch::get_tags_groups(std::vector<TagsEditGroup>& groups)
+  {
+    typedef std::map<const TagEditsMap*, size_t, CompareTagEdits> GroupsIndex;
+    GroupsIndex groups_index;
+
+    FilesMap::iterator file_iterator = this->files.begin();
+    for (; file_iterator != this->files.end(); ++file_iterator)
+    {
+      const TagEditsMap& tags = file_iterator->second.tags;
+      if (tags.empty())
+      {
+        continue;
+      }
+
+      std::pair<GroupsIndex::iterator, bool> inserted =
+          groups_index.insert(GroupsIndex::value_type(&tags, groups.size()));
+      if (inserted.second)
+      {
+        // A new group.
+        groups.push_back(TagsEditGroup());
+        TagsEditGroup& group = groups.back();
+
+        TagEditsMap::const_iterator tag_iterator = tags.begin();
+        for (; tag_iterator != tags.end(); ++tag_iterator)
+        {
+          if (tag_iterator->second)
+          {
+            group.assigned_tags.push_back(tag_iterator->first.c_str());
+          }
+          else
+          {
+            group.unassigned_tags.push_back(tag_iterator->first.c_str());
+          }
+        }
+      }
+
+      groups[inserted.first->second].file_ids.push_back(
+          file_iterator->first.c_str());
+    }
+  }
+
+  void EditBatch::get_title_groups(std::vector<TitleGroup>& groups)
+  {
+    std::map<std::string, size_t> groups_index;
+
+    FilesMap::iterator file_iterator = this->files.begin();
+    for (; file_iterator != this->files.end(); ++file_iterator)
+    {
+      if (!file_iterator->second.has_title)
+      {
+        continue;
+      }
+
+      const std::string& title = file_iterator->second.title;
+      std::pair<std::map<std::string, size_t>::iterator, bool> inserted =
+          groups_index.insert(std::make_pair(title, groups.size()));
+      if (inserted.second)
+      {
+        groups.push_back(TitleGroup());
+        groups.back().title = title.c_str();
+      }
+
+      groups[inserted.first->second].file_ids.push_back(
+          file_iterator->first.c_str());
+    }
+  }
+
+  void EditBatch::get_file_ids(std::vector<const char*>& file_ids)
+  {
+    FilesMap::iterator file_iterator = this->files.begin();
+    for (; file_iterator != this->files.end(); ++file_iterator)
+    {
+      file_ids.push_back(file_iterator->first.c_str());
+    }
+  }
+
+  void EditBatch::clear()
+  {
+    this->files.clear();
+  }
+
+  unsigned long EditBatch::get_queued()
+  {
+    return this->queued;
+  }
+
+  unsigned long EditBatch::get_coalesced()
+  {
+    return this->coalesced;
+  }
+
+  unsigned long EditBatch::get_calls()
+  {
+    return this->calls;
+  }
+
+  void EditBatch::add_calls(unsigned long calls)
+  {
+    this->calls += calls;
+  }
+
+  EditBatch::FileEdits& EditBatch::get_file_edits(const char* file_id)
+  {
+    FilesMap::iterator found = this->files.lower_bound(file_id);
+    if (found == this->files.end() || found->first != file_id)
+    {
+      FileEdits file_edits;
+      file_edits.has_title = false;
+      found = this->files.insert(found, FilesMap::value_type(file_id, file_edits));
+    }
+
+    return found->second;
+  }
+
+}
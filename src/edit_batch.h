@@ -0,0 +1,148 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_EDIT_BATCH_H_INCLUDED
+#define LIBTOCC_PYTHON_EDIT_BATCH_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Keeps tag and title edits of many files, so they can be applied by a
+   * few bulk libtocc calls instead of one call per edit.
+   *
+   * Edits are merged per file: the last edit of a tag (assign or
+   * unassign) and the last title win. Then files with the same edits are
+   * grouped, so each group needs one call.
+   */
+  class EditBatch
+  {
+  public:
+    /*
+     * Files that have exactly the same tag edits.
+     */
+    struct TagsEditGroup
+    {
+      std::vector<const char*> file_ids;
+      std::vector<const char*> assigned_tags;
+      std::vector<const char*> unassigned_tags;
+    };
+
+    /*
+     * Files that get the same title.
+     */
+    struct TitleGroup
+    {
+      const char* title;
+      std::vector<const char*> file_ids;
+    };
+
+    EditBatch();
+
+    /*
+     * Adds an edit of a tag.
+     *
+     * @param assign: true to assign the tag, false to unassign it.
+     */
+    void edit_tag(const char* file_id, const char* tag, bool assign);
+
+    void set_title(const char* file_id, const char* title);
+
+    bool is_empty();
+
+    /*
+     * Adds the edits of the other batch, as if they're made after the
+     * edits of this one.
+     */
+    void merge(EditBatch& other);
+
+    /*
+     * Groups the tag edits. Pointers are valid until the batch is
+     * changed or cleared.
+     */
+    void get_tags_groups(std::vector<TagsEditGroup>& groups);
+
+    /*
+     * Groups the titles. Pointers are valid until the batch is changed
+     * or cleared.
+     */
+    void get_title_groups(std::vector<TitleGroup>& groups);
+
+    /*
+     * Returns IDs of all of the edited files.
+     */
+    void get_file_ids(std::vector<const char*>& file_ids);
+
+    /*
+     * Discards the edits. Counters are kept.
+     */
+    void clear();
+
+    /*
+     * Number of the edits that are added.
+     */
+    unsigned long get_queued();
+
+    /*
+     * Number of the edits that are replaced by a later edit.
+     */
+    unsigned long get_coalesced();
+
+    /*
+     * Number of the libtocc calls that applied the edits.
+     */
+    unsigned long get_calls();
+
+    void add_calls(unsigned long calls);
+
+  private:
+    // Tag to true (assign) or false (unassign).
+    typedef std::map<std::string, bool> TagEditsMap;
+
+    struct FileEdits
+    {
+      TagEditsMap tags;
+      bool has_title;
+      std::string title;
+    };
+    typedef std::map<std::string, FileEdits> FilesMap;
+
+    // Batch is not copyable.
+    EditBatch(const EditBatch&);
+    EditBatch& operator=(const EditBatch&);
+
+    /*
+     * Returns the edits of the file. Creates it if it's not exist.
+     */
+    FileEdits& get_file_edits(const char* file_id);
+
+    FilesMap files;
+    unsigned long queued;
+    unsigned long coalesced;
+    unsigned long calls;
+  };
+
+}
+
+#endif /* LIBTOCC_PYTHON_EDIT_BATCH_H_INCLUDED */
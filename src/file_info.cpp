@@ -22,7 +22,16 @@
 #include "file_info.h"
 #include "utilities.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <new>
+#include <string>
+#include <vector>
 
 
 /*
@@ -31,26 +40,107 @@
 typedef struct
 {
   PyObject_HEAD
+  /*
+   * Points to `file_info_storage' if a FileInfo is constructed there,
+   * otherwise it's NULL.
+   */
   libtocc::FileInfo* file_info_instance;
+  /*
+   * The libtocc::FileInfo is constructed in place inside the object, so
+   * creating a FileInfoObject costs a single allocation.
+   */
+  union
+  {
+    char file_info_storage[sizeof(libtocc::FileInfo)];
+    // These are only here to align the storage.
+    void* storage_pointer_alignment;
+    long long storage_integer_alignment;
+    double storage_double_alignment;
+  };
+  /*
+   * Python values of the FileInfo's fields. Each one is created on its
+   * first access, and kept until the object is destructed.
+   * Tags are kept as a tuple, so they can be shared safely.
+   */
+  PyObject* id_cache;
+  PyObject* title_cache;
+  PyObject* traditional_path_cache;
+  PyObject* physical_path_cache;
+  PyObject* tags_cache;
 } FileInfoObject;
 
+/*
+ * Maximum number of deallocated FileInfoObjects that are kept for
+ * recycling.
+ */
+#define FILE_INFO_FREE_LIST_MAX_SIZE 256
+
+/*
+ * Deallocated FileInfoObjects, kept to be reused by
+ * create_python_file_info. Their FileInfo is already destructed.
+ */
+static FileInfoObject* file_info_free_list[FILE_INFO_FREE_LIST_MAX_SIZE];
+static int file_info_free_list_size = 0;
+
+/*
+ * Constructs a copy of the specified FileInfo inside the object.
+ */
+static void file_info_object_construct(FileInfoObject* self,
+                                       const libtocc::FileInfo& file_info)
+{
+  self->file_info_instance =
+      new (self->file_info_storage) libtocc::FileInfo(file_info);
+
+  self->id_cache = NULL;
+  self->title_cache = NULL;
+  self->traditional_path_cache = NULL;
+  self->physical_path_cache = NULL;
+  self->tags_cache = NULL;
+}
+
+/*
+ * Destructs the FileInfo kept inside the object, if there's any.
+ */
+static void file_info_object_destruct(FileInfoObject* self)
+{
+  if (self->file_info_instance != NULL)
+  {
+    self->file_info_instance->~FileInfo();
+    self->file_info_instance = NULL;
+
+    Py_CLEAR(self->id_cache);
+    Py_CLEAR(self->title_cache);
+    Py_CLEAR(self->traditional_path_cache);
+    Py_CLEAR(self->physical_path_cache);
+    Py_CLEAR(self->tags_cache);
+  }
+}
+
+/*
+ * Parameters of the FileInfo's constructor.
+ */
+static const char* file_info_init_kwlist[] = { "file_id", NULL };
+
 /*
  * __init__ method.
  */
 static int file_info_init(FileInfoObject* self, PyObject* args, PyObject* kwargs)
 {
-  char* file_id;
-  static char* kwlist[] = { "file_id", NULL };
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                   "s",
-                                   kwlist,
-                                   &file_id))
+  PyObject* values[1];
+  if (!libtocc_python::unpack_tuple_args("FileInfo", args, kwargs,
+                                         file_info_init_kwlist, 1, values))
+  {
+    return -1;
+  }
+  const char* file_id = libtocc_python::python_unicode_to_char(values[0]);
+  if (file_id == NULL)
   {
     return -1;
   }
 
-  self->file_info_instance = new libtocc::FileInfo(file_id);
+  // __init__ may be called more than once.
+  file_info_object_destruct(self);
+  file_info_object_construct(self, libtocc::FileInfo(file_id));
 
   return 0;
 }
@@ -60,72 +150,318 @@ static int file_info_init(FileInfoObject* self, PyObject* args, PyObject* kwargs
  */
 static void file_info_object_dealloc(FileInfoObject* self)
 {
-  if (self->file_info_instance != NULL)
+  file_info_object_destruct(self);
+
+  // Note that FileInfo can't be sub-classed, so all of the objects have
+  // the same size.
+  if (file_info_free_list_size < FILE_INFO_FREE_LIST_MAX_SIZE)
   {
-    delete self->file_info_instance;
-    self->file_info_instance = NULL;
+    // Keeping the object for later use.
+    file_info_free_list[file_info_free_list_size] = self;
+    file_info_free_list_size++;
+    return;
   }
+
   PyObject_Del(self);
 }
 
-static PyObject* file_info_get_id(FileInfoObject* self)
+/*
+ * Returns a new reference to the cached str. Creates it from the
+ * specified value if it's not cached yet.
+ */
+static PyObject* get_cached_string(PyObject** cache, const char* value)
 {
-  const char* file_id = self->file_info_instance->get_id();
+  if (*cache == NULL)
+  {
+    *cache = PyUnicode_FromString(value);
+    if (*cache == NULL)
+    {
+      return NULL;
+    }
+  }
 
-  return PyUnicode_FromString(file_id);
+  Py_INCREF(*cache);
+  return *cache;
 }
 
-static PyObject* file_info_get_title(FileInfoObject* self)
+static PyObject* file_info_get_id(FileInfoObject* self)
 {
-  const char* file_title = self->file_info_instance->get_title();
+  return get_cached_string(&self->id_cache,
+                           self->file_info_instance->get_id());
+}
 
-  return PyUnicode_FromString(file_title);
+static PyObject* file_info_get_title(FileInfoObject* self)
+{
+  return get_cached_string(&self->title_cache,
+                           self->file_info_instance->get_title());
 }
 
 static PyObject* file_info_get_traditional_path(FileInfoObject* self)
 {
-  const char* traditional_path = self->file_info_instance->get_traditional_path();
-
-  return PyUnicode_FromString(traditional_path);
+  return get_cached_string(&self->traditional_path_cache,
+                           self->file_info_instance->get_traditional_path());
 }
 
 static PyObject* file_info_get_physical_path(FileInfoObject* self)
 {
-  const char* physical_path = self->file_info_instance->get_physical_path();
-
-  return PyUnicode_FromString(physical_path);
+  return get_cached_string(&self->physical_path_cache,
+                           self->file_info_instance->get_physical_path());
 }
 
 static PyObject* file_info_get_tags(FileInfoObject* self)
 {
+  if (self->tags_cache != NULL)
+  {
+    Py_INCREF(self->tags_cache);
+    return self->tags_cache;
+  }
+
   libtocc::TagsCollection tags_collection = self->file_info_instance->get_tags();
 
-  if (tags_collection.size() == 0)
+  // Converting tags collection into python tuple.
+  PyObject* tags_tuple = PyTuple_New(tags_collection.size());
+  if (tags_tuple == NULL)
   {
-    // Returning an empty list.
-    return PyList_New(0);
+    return NULL;
   }
 
-  // Converting tags collection into python list.
-  PyObject* tags_list = PyList_New(tags_collection.size());
-  if (tags_list == NULL)
+  int tuple_index = 0;
+  libtocc::TagsCollection::Iterator iterator(&tags_collection);
+  for (; !iterator.is_finished(); iterator.next())
+  {
+    PyObject* tag = PyUnicode_FromString(iterator.get());
+    if (tag == NULL)
+    {
+      Py_DECREF(tags_tuple);
+      return NULL;
+    }
+    PyTuple_SET_ITEM(tags_tuple, tuple_index, tag);
+    tuple_index++;
+  }
+
+  self->tags_cache = tags_tuple;
+
+  Py_INCREF(self->tags_cache);
+  return self->tags_cache;
+}
+
+/*
+ * Defines a Python class, that owns a read-only mapping of a file.
+ * It exports the mapping through the buffer protocol, and unmaps it
+ * when it's deallocated. Since a memoryview keeps a reference to its
+ * exporter, the mapping lives as long as any view of it.
+ */
+typedef struct
+{
+  PyObject_HEAD
+  // NULL if the file is empty. (Empty files can't be mapped.)
+  void* data;
+  size_t size;
+} MappedFileObject;
+
+/*
+ * Destructor.
+ */
+static void mapped_file_object_dealloc(MappedFileObject* self)
+{
+  if (self->data != NULL)
+  {
+    munmap(self->data, self->size);
+    self->data = NULL;
+  }
+
+  PyObject_Del(self);
+}
+
+static int mapped_file_get_buffer(MappedFileObject* self, Py_buffer* view,
+                                  int flags)
+{
+  // An empty buffer still needs a valid pointer.
+  static char empty_data[1];
+  void* data = self->data != NULL ? self->data : empty_data;
+
+  return PyBuffer_FillInfo(view, (PyObject*)self, data, (Py_ssize_t)self->size,
+                           1, flags);
+}
+
+static PyBufferProcs mapped_file_buffer_procs =
+{
+  (getbufferproc)mapped_file_get_buffer,
+  NULL,
+};
+
+/*
+ * Definition of Type.
+ */
+static PyTypeObject MappedFileType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "file_info.MappedFile",
+  sizeof(MappedFileObject),
+  0,
+  /* Methods */
+  (destructor)mapped_file_object_dealloc,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  &mapped_file_buffer_procs,
+  Py_TPFLAGS_DEFAULT,
+  PyDoc_STR("A read-only mapping of a file. It's used as the exporter of\n"
+            "the memoryview that FileInfo.open_mapped returns.\n"
+            "You shouldn't create an instance of this class directly."),
+};
+
+/*
+ * Converts the access argument of open_mapped to a madvise advice.
+ *
+ * @return: false if it's not valid. It sets the Python Error.
+ */
+static bool python_to_madvise_advice(PyObject* access, int* out_advice)
+{
+  *out_advice = MADV_NORMAL;
+  if (access == NULL || access == Py_None)
+  {
+    return true;
+  }
+
+  const char* access_str = libtocc_python::python_unicode_to_char(access);
+  if (access_str == NULL)
+  {
+    return false;
+  }
+
+  if (strcmp(access_str, "normal") == 0)
+  {
+    *out_advice = MADV_NORMAL;
+  }
+  else if (strcmp(access_str, "sequential") == 0)
+  {
+    *out_advice = MADV_SEQUENTIAL;
+  }
+  else if (strcmp(access_str, "random") == 0)
+  {
+    *out_advice = MADV_RANDOM;
+  }
+  else
+  {
+    PyErr_Format(PyExc_ValueError,
+                 "access should be 'normal', 'sequential' or 'random', not '%s'",
+                 access_str);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Maps the specified file read-only.
+ *
+ * @return: errno of the failed call, or zero.
+ */
+static int map_file(const char* physical_path, int advice, void** out_data,
+                    size_t* out_size)
+{
+  *out_data = NULL;
+  *out_size = 0;
+
+  int fd = open(physical_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return errno;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0)
+  {
+    int error_number = errno;
+    close(fd);
+    return error_number;
+  }
+  if (file_stat.st_size == 0)
+  {
+    close(fd);
+    return 0;
+  }
+
+  void* data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_SHARED,
+                    fd, 0);
+  int error_number = errno;
+  // The mapping doesn't need the descriptor.
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return error_number;
+  }
+
+  // It's only a hint, so its failure is ignored.
+  madvise(data, (size_t)file_stat.st_size, advice);
+
+  *out_data = data;
+  *out_size = (size_t)file_stat.st_size;
+  return 0;
+}
+
+static PyObject* file_info_open_mapped(FileInfoObject* self,
+                                       PyObject* const* args, Py_ssize_t nargs,
+                                       PyObject* kwnames)
+{
+  static const char* kwlist[] = { "access", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("open_mapped", args, nargs, kwnames,
+                                            kwlist, 0, values))
+  {
+    return NULL;
+  }
+  int advice;
+  if (!python_to_madvise_advice(values[0], &advice))
   {
     return NULL;
   }
 
-  libtocc_python::PyObjectHolder(tags_list, true);
+  // The path is borrowed from the FileInfo, so it's copied before the GIL
+  // is released.
+  std::string physical_path(self->file_info_instance->get_physical_path());
+  void* data;
+  size_t size;
 
-  int list_index = 0;
-  libtocc::TagsCollection::Iterator iterator(&tags_collection);
-  for (; !iterator.is_finished(); iterator.next())
+  libtocc_python::GILReleaser gil_releaser(NULL);
+  int error_number = map_file(physical_path.c_str(), advice, &data, &size);
+  gil_releaser.restore();
+
+  if (error_number != 0)
   {
-    // I used SET_ITEM instead of SetItem because it's faster for newly
-    // created lists.
-    PyList_SET_ITEM(tags_list, list_index, PyUnicode_FromString(iterator.get()));
-    list_index++;
+    errno = error_number;
+    return PyErr_SetFromErrnoWithFilename(PyExc_OSError, physical_path.c_str());
+  }
+
+  MappedFileObject* mapped_file = PyObject_New(MappedFileObject, &MappedFileType);
+  if (mapped_file == NULL)
+  {
+    if (data != NULL)
+    {
+      munmap(data, size);
+    }
+    return NULL;
   }
+  mapped_file->data = data;
+  mapped_file->size = size;
 
-  return tags_list;
+  PyObject* result = PyMemoryView_FromObject((PyObject*)mapped_file);
+  // The view keeps its own reference.
+  Py_DECREF(mapped_file);
+
+  return result;
 }
 
 /*
@@ -151,11 +487,55 @@ static PyMethodDef file_info_methods[] =
   },
   {
     "get_tags", (PyCFunction)file_info_get_tags, METH_NOARGS,
-    PyDoc_STR("Returns list of tags assigned to this file.\n\n@return: list of str")
+    PyDoc_STR("Returns tags assigned to this file.\n\n@return: tuple of str")
+  },
+  {
+    "open_mapped", (PyCFunction)file_info_open_mapped, METH_FASTCALL | METH_KEYWORDS,
+    PyDoc_STR("Maps the physical file into memory, and returns a read-only\n"
+              "view of it. Its contents are read by the kernel as they're\n"
+              "accessed, without being copied.\n"
+              "The file is unmapped when the view (and every view or slice\n"
+              "made from it) is released or garbage collected.\n"
+              "Note that the file shouldn't be truncated while it's mapped;\n"
+              "accessing the removed part raises SIGBUS.\n"
+              "\n"
+              "@keyword access: (str) How the view is going to be read. It's\n"
+              "  passed to the kernel as a hint. One of 'normal' (default),\n"
+              "  'sequential' or 'random'.\n"
+              "\n"
+              "@return: memoryview")
   },
   {NULL, NULL}
 };
 
+/*
+ * Read-only attributes of FileInfo class.
+ */
+static PyGetSetDef file_info_getset[] =
+{
+  {
+    "id", (getter)file_info_get_id, NULL,
+    PyDoc_STR("ID of the file. (str)")
+  },
+  {
+    "title", (getter)file_info_get_title, NULL,
+    PyDoc_STR("Title of the file. (str)")
+  },
+  {
+    "traditional_path", (getter)file_info_get_traditional_path, NULL,
+    PyDoc_STR("Traditional Path of the file. (str)")
+  },
+  {
+    "physical_path", (getter)file_info_get_physical_path, NULL,
+    PyDoc_STR("Physical Path of the file. (str)")
+  },
+  {
+    "tags", (getter)file_info_get_tags, NULL,
+    PyDoc_STR("Tags assigned to this file. (tuple of str)")
+  },
+  {NULL}
+};
+
 /*
  * Definition of Type.
  */
@@ -192,7 +572,7 @@ static PyTypeObject FileInfoType =
   0,
   file_info_methods,
   0,
-  0,
+  file_info_getset,
   0,
   0,
   0,
@@ -201,12 +581,218 @@ static PyTypeObject FileInfoType =
   (initproc)file_info_init,
 };
 
+/*
+ * Defines a Python class, for iterating over a FileInfoCollection.
+ */
+typedef struct
+{
+  PyObject_HEAD
+  libtocc::FileInfoCollection* file_info_collection;
+  libtocc::FileInfoCollection::Iterator* iterator;
+  // Number of items that are not returned yet.
+  Py_ssize_t remaining;
+  // Index of the next item in the whole collection.
+  Py_ssize_t position;
+} FileInfoIteratorObject;
+
+/*
+ * Destructor.
+ */
+static void file_info_iterator_object_dealloc(FileInfoIteratorObject* self)
+{
+  // Iterator should be deleted before its collection.
+  delete self->iterator;
+  self->iterator = NULL;
+  delete self->file_info_collection;
+  self->file_info_collection = NULL;
+
+  PyObject_Del(self);
+}
+
+/*
+ * __next__ method.
+ */
+static PyObject* file_info_iterator_next(FileInfoIteratorObject* self)
+{
+  if (self->iterator == NULL || self->remaining <= 0 ||
+      self->iterator->is_finished())
+  {
+    // Returning NULL without setting an error means StopIteration.
+    return NULL;
+  }
+
+  PyObject* result = create_python_file_info(*self->iterator->get());
+  if (result == NULL)
+  {
+    return NULL;
+  }
+
+  self->iterator->next();
+  self->remaining--;
+  self->position++;
+
+  return result;
+}
+
+static PyObject* file_info_iterator_length_hint(FileInfoIteratorObject* self)
+{
+  return PyLong_FromSsize_t(self->remaining);
+}
+
+static PyObject* file_info_iterator_fetch(FileInfoIteratorObject* self,
+                                          PyObject* const* args, Py_ssize_t nargs,
+                                          PyObject* kwnames)
+{
+  static const char* kwlist[] = { "count", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("fetch", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+  Py_ssize_t count;
+  if (!libtocc_python::python_to_ssize_t(values[0], &count))
+  {
+    return NULL;
+  }
+
+  if (count < 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "count can't be negative.");
+    return NULL;
+  }
+  if (count > self->remaining)
+  {
+    count = self->remaining;
+  }
+
+  PyObject* page = PyList_New(count);
+  if (page == NULL)
+  {
+    return NULL;
+  }
+
+  for (Py_ssize_t i = 0; i < count; i++)
+  {
+    PyObject* item = file_info_iterator_next(self);
+    if (item == NULL)
+    {
+      Py_DECREF(page);
+      return NULL;
+    }
+    PyList_SET_ITEM(page, i, item);
+  }
+
+  return page;
+}
+
+/*
+ * Methods of FileInfoIterator class.
+ */
+static PyMethodDef file_info_iterator_methods[] =
+{
+  {
+    "__length_hint__", (PyCFunction)file_info_iterator_length_hint, METH_NOARGS,
+    PyDoc_STR("Returns number of the remaining items.")
+  },
+  {
+    "fetch", (PyCFunction)file_info_iterator_fetch, METH_FASTCALL | METH_KEYWORDS,
+    PyDoc_STR("Returns the next page of files.\n"
+              "The iterator keeps its position, so calling this again\n"
+              "returns the page after.\n"
+              "\n"
+              "@param count: (int) Maximum number of files to return.\n"
+              "\n"
+              "@return: list of FileInfo. It's empty if there's no more files.")
+  },
+  {NULL, NULL}
+};
+
+static PyObject* file_info_iterator_get_position(FileInfoIteratorObject* self)
+{
+  return PyLong_FromSsize_t(self->position);
+}
+
+/*
+ * Read-only attributes of FileInfoIterator class.
+ */
+static PyGetSetDef file_info_iterator_getset[] =
+{
+  {
+    "position", (getter)file_info_iterator_get_position, NULL,
+    PyDoc_STR("Index of the next file in the whole search result. (int)\n"
+              "The iterator itself only lives in this process. To resume\n"
+              "later (e.g. on the next request of a web client), keep this\n"
+              "number and pass it as `offset' to a new search. Note that\n"
+              "files imported or removed in between shift the results.")
+  },
+  {NULL}
+};
+
+/*
+ * Definition of Type.
+ */
+static PyTypeObject FileInfoIteratorType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "file_info.FileInfoIterator",
+  sizeof(FileInfoIteratorObject),
+  0,
+  /* Methods */
+  (destructor)file_info_iterator_object_dealloc,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  Py_TPFLAGS_DEFAULT,
+  PyDoc_STR("Iterates over a list of files, and creates each FileInfo\n"
+            "when it's reached.\n"
+            "It can be used as a cursor over search results: keep it, and\n"
+            "call `fetch' for each page. Its `position' can be passed to\n"
+            "a later search as `offset', to resume from the same place.\n"
+            "You shouldn't create an instance of this class directly."),
+  0,
+  0,
+  0,
+  0,
+  PyObject_SelfIter,
+  (iternextfunc)file_info_iterator_next,
+  file_info_iterator_methods,
+  0,
+  file_info_iterator_getset,
+};
+
 /*
  * Definitions of Module.
  */
 PyDoc_STRVAR(module_doc,
   "Defines FileInfo class.");
 
+/*
+ * Called when the module is deallocated. Frees the FileInfoObjects kept
+ * for recycling.
+ */
+static void file_info_module_free(void* module)
+{
+  while (file_info_free_list_size > 0)
+  {
+    file_info_free_list_size--;
+    PyObject_Del(file_info_free_list[file_info_free_list_size]);
+    file_info_free_list[file_info_free_list_size] = NULL;
+  }
+}
+
 static struct PyModuleDef file_info_module = {
     PyModuleDef_HEAD_INIT,
     "file_info",
@@ -216,7 +802,7 @@ static struct PyModuleDef file_info_module = {
     NULL,
     NULL,
     NULL,
-    NULL
+    file_info_module_free
 };
 
 /*
@@ -233,17 +819,53 @@ bool is_python_file_info(PyObject* object)
 PyObject* create_python_file_info(const libtocc::FileInfo& file_info)
 {
   FileInfoObject* self;
-  self = PyObject_New(FileInfoObject, &FileInfoType);
-  if (self == NULL)
+
+  if (file_info_free_list_size > 0)
   {
-    return NULL;
+    // Recycling a deallocated object.
+    file_info_free_list_size--;
+    self = file_info_free_list[file_info_free_list_size];
+    PyObject_Init((PyObject*)self, &FileInfoType);
+  }
+  else
+  {
+    self = PyObject_New(FileInfoObject, &FileInfoType);
+    if (self == NULL)
+    {
+      return NULL;
+    }
   }
 
-  self->file_info_instance = new libtocc::FileInfo(file_info);
+  file_info_object_construct(self, file_info);
 
   return (PyObject*)self;
 }
 
+#if PY_VERSION_HEX >= 0x03090000
+/*
+ * Vectorcall constructor. Calling `FileInfo(file_id)' comes here directly,
+ * without packing the arguments into a tuple, and it reuses the free list.
+ */
+static PyObject* file_info_vectorcall(PyObject* type, PyObject* const* args,
+                                      size_t nargsf, PyObject* kwnames)
+{
+  PyObject* values[1];
+  if (!libtocc_python::unpack_fastcall_args("FileInfo", args,
+                                            PyVectorcall_NARGS(nargsf), kwnames,
+                                            file_info_init_kwlist, 1, values))
+  {
+    return NULL;
+  }
+  const char* file_id = libtocc_python::python_unicode_to_char(values[0]);
+  if (file_id == NULL)
+  {
+    return NULL;
+  }
+
+  return create_python_file_info(libtocc::FileInfo(file_id));
+}
+#endif
+
 /*
  * Creates a list of Python objects from the specified FileInfoCollection.
  */
@@ -258,62 +880,239 @@ PyObject* create_python_file_info_list(
 
   // Converting collection into list.
   PyObject* file_info_list = PyList_New(file_info_collection.size());
-
-  Py_INCREF(file_info_list);
+  if (file_info_list == NULL)
+  {
+    return NULL;
+  }
 
   int list_index = 0;
   libtocc::FileInfoCollection::Iterator iterator(&file_info_collection);
-  for (; iterator.is_finished(); iterator.next())
+  for (; !iterator.is_finished(); iterator.next())
   {
-    PyList_SET_ITEM(file_info_list, list_index,
-                    create_python_file_info(*iterator.get()));
+    PyObject* file_info = create_python_file_info(*iterator.get());
+    if (file_info == NULL)
+    {
+      Py_DECREF(file_info_list);
+      return NULL;
+    }
+    PyList_SET_ITEM(file_info_list, list_index, file_info);
     list_index++;
   }
 
-  Py_DECREF(file_info_list);
   return file_info_list;
 }
 
 /*
- * Creates a list of file IDs.
- *
- * @param files_list: can be a list of Strings, or a list of FileInfo, or a list
- *   of both.
- * @param out_array: Array to fill. This method allocates memory for
- *   specified the pointer.
- *
- * @return: false if any errors happen.
- *   It sets the Python Error if error happen.
+ * Creates an iterator over the specified FileInfoCollection.
+ * The iterator takes the ownership of the collection.
  */
-bool create_file_ids_array(PyObject* files_list, char** out_array)
+PyObject* create_python_file_info_iterator(
+    libtocc::FileInfoCollection* file_info_collection,
+    Py_ssize_t offset, Py_ssize_t limit)
 {
-  //out_array = malloc(PyList_Size(files_list) * sizeof(char*));
-  out_array = new char*[PyList_Size(files_list)];
+  FileInfoIteratorObject* self;
+  self = PyObject_New(FileInfoIteratorObject, &FileInfoIteratorType);
+  if (self == NULL)
+  {
+    delete file_info_collection;
+    return NULL;
+  }
 
-  for (int i = 0; i < PyList_Size(files_list); i++)
+  self->file_info_collection = file_info_collection;
+  self->iterator =
+      new libtocc::FileInfoCollection::Iterator(file_info_collection);
+  self->remaining = file_info_collection->size();
+
+  self->position = offset;
+
+  // Skipping the items before the offset, without converting them.
+  for (Py_ssize_t i = 0; i < offset && !self->iterator->is_finished(); i++)
   {
-    PyObject* list_item = PyList_GetItem(files_list, i);
+    self->iterator->next();
+    self->remaining--;
+  }
 
-    if (is_python_file_info(list_item))
+  if (limit >= 0 && limit < self->remaining)
+  {
+    self->remaining = limit;
+  }
+
+  return (PyObject*)self;
+}
+
+/*
+ * Copies each visited file ID to an arena. FileInfo items are accepted
+ * too, and their IDs are used.
+ */
+class FileIdsArrayBuilder : public libtocc_python::StringsVisitor
+{
+public:
+  /*
+   * @param known_size: Number of the IDs, if it's known before visiting
+   *   them. Then the array is allocated from the arena up front.
+   *   Otherwise it should be -1.
+   */
+  FileIdsArrayBuilder(libtocc_python::StringArena& arena, Py_ssize_t known_size)
+    : arena(arena)
+  {
+    this->array = NULL;
+    this->size = 0;
+    if (known_size >= 0)
     {
-      out_array[i] = (char*)
-          ((FileInfoObject*)list_item)->file_info_instance->get_id();
+      this->array = (const char**)arena.allocate(known_size * sizeof(char*));
     }
-    else if (PyUnicode_Check(list_item))
+  }
+
+  virtual bool visit(const char* str, Py_ssize_t size)
+  {
+    const char* file_id = this->arena.copy(str, size);
+    if (this->array != NULL)
     {
-      out_array[i] = libtocc_python::python_unicode_to_char(list_item);
+      this->array[this->size] = file_id;
     }
     else
+    {
+      this->growing_array.push_back(file_id);
+    }
+    this->size++;
+    return true;
+  }
+
+  virtual bool visit_object(PyObject* item)
+  {
+    if (!is_python_file_info(item))
     {
       PyErr_Format(PyExc_TypeError,
                    "The argument should be a list of str or FileInfo."
                    "But something [%s] found!",
-                   Py_TYPE(list_item)->tp_name);
-      delete[] out_array;
+                   Py_TYPE(item)->tp_name);
       return false;
     }
+
+    const char* file_id =
+        ((FileInfoObject*)item)->file_info_instance->get_id();
+    return visit(file_id, strlen(file_id));
   }
 
+  /*
+   * Returns the array of the visited IDs. It's allocated from the arena.
+   */
+  const char** get_array()
+  {
+    if (this->array == NULL)
+    {
+      this->array = (const char**)this->arena.allocate(this->size * sizeof(char*));
+      for (int i = 0; i < this->size; i++)
+      {
+        this->array[i] = this->growing_array[i];
+      }
+    }
+    return this->array;
+  }
+
+  int get_size()
+  {
+    return this->size;
+  }
+
+private:
+  libtocc_python::StringArena& arena;
+  const char** array;
+  // Used instead of `array' if size is not known up front.
+  std::vector<const char*> growing_array;
+  int size;
+};
+
+/*
+ * Calculates the memory needed for copying IDs of the specified list or
+ * tuple to an arena.
+ *
+ * @return: -1 if any of the items is not a str or FileInfo. It doesn't set
+ *   the Python Error, since the conversion itself will report it.
+ */
+static Py_ssize_t file_ids_total_size(PyObject* files_list)
+{
+  Py_ssize_t list_size = PySequence_Fast_GET_SIZE(files_list);
+  PyObject** items = PySequence_Fast_ITEMS(files_list);
+  Py_ssize_t total_size = list_size * sizeof(char*);
+
+  for (Py_ssize_t i = 0; i < list_size; i++)
+  {
+    if (is_python_file_info(items[i]))
+    {
+      total_size +=
+          strlen(((FileInfoObject*)items[i])->file_info_instance->get_id()) + 1;
+    }
+    else if (PyUnicode_Check(items[i]))
+    {
+      Py_ssize_t id_size;
+      if (libtocc_python::python_unicode_to_char(items[i], &id_size) == NULL)
+      {
+        PyErr_Clear();
+        return -1;
+      }
+      total_size += id_size + 1;
+    }
+    else
+    {
+      return -1;
+    }
+  }
+
+  return total_size;
+}
+
+/*
+ * Creates an array of file IDs.
+ *
+ * @param files_list: A collection of str or FileInfo (or a mix of them).
+ *   It can be a list, a tuple, any iterable, or a buffer of packed IDs.
+ * @param arena: The array and the IDs are copied to this arena. They're
+ *   valid until the arena is destroyed, even if the GIL is released.
+ * @param out_array: Will point to the created array.
+ * @param out_size: Will be set to the size of the created array.
+ *
+ * @return: false if any errors happen.
+ *   It sets the Python Error if error happen.
+ */
+bool create_file_ids_array(PyObject* files_list,
+                           libtocc_python::StringArena& arena,
+                           const char*** out_array,
+                           int* out_size)
+{
+  // Returned for an empty collection, so the arena doesn't allocate a
+  // block for nothing.
+  static const char* empty_array[1] = { NULL };
+
+  Py_ssize_t known_size = -1;
+
+  if (PyList_Check(files_list) || PyTuple_Check(files_list))
+  {
+    if (PySequence_Fast_GET_SIZE(files_list) == 0)
+    {
+      *out_array = empty_array;
+      *out_size = 0;
+      return true;
+    }
+
+    // Size is known, so the arena allocates once.
+    Py_ssize_t total_size = file_ids_total_size(files_list);
+    if (total_size > 0)
+    {
+      arena.reserve(total_size);
+    }
+    known_size = PySequence_Fast_GET_SIZE(files_list);
+  }
+
+  FileIdsArrayBuilder builder(arena, known_size);
+  if (!libtocc_python::visit_strings(files_list, builder,
+                                     libtocc_python::FILE_ID_SIZE))
+  {
+    return false;
+  }
+
+  *out_size = builder.get_size();
+  *out_array = *out_size > 0 ? builder.get_array() : empty_array;
   return true;
 }
 
@@ -345,11 +1144,24 @@ PyMODINIT_FUNC PyInit_file_info(void)
 
   // Creating module.
   FileInfoType.tp_new = PyType_GenericNew;
+#if PY_VERSION_HEX >= 0x03090000
+  FileInfoType.tp_vectorcall = file_info_vectorcall;
+#endif
   if (PyType_Ready(&FileInfoType) < 0)
   {
     Py_XDECREF(module);
     return NULL;
   }
+  if (PyType_Ready(&FileInfoIteratorType) < 0)
+  {
+    Py_XDECREF(module);
+    return NULL;
+  }
+  if (PyType_Ready(&MappedFileType) < 0)
+  {
+    Py_XDECREF(module);
+    return NULL;
+  }
 
   // Creating FileInfo type and adding it to module.
   module = PyModule_Create(&file_info_module);
@@ -360,6 +1172,8 @@ PyMODINIT_FUNC PyInit_file_info(void)
   }
 
   PyModule_AddObject(module, "FileInfo", (PyObject*)&FileInfoType);
+  PyModule_AddObject(module, "FileInfoIterator", (PyObject*)&FileInfoIteratorType);
+  PyModule_AddObject(module, "MappedFile", (PyObject*)&MappedFileType);
 
   // Creating C API and adding it to module.
 
@@ -369,6 +1183,8 @@ PyMODINIT_FUNC PyInit_file_info(void)
   FileInfoAPI[FILE_INFO_CREATE_LIST_NUM] = (void*)create_python_file_info_list;
   FileInfoAPI[FILE_INFO_CREATE_FILE_IDS_NUM] = (void*)create_file_ids_array;
   FileInfoAPI[FILE_INFO_GET_NUM] = (void*)python_file_info_get;
+  FileInfoAPI[FILE_INFO_CREATE_ITERATOR_NUM] =
+      (void*)create_python_file_info_iterator;
 
   // Capsule object.
   c_api_object = PyCapsule_New((void*)FileInfoAPI, "file_info._C_API", NULL);
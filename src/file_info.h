@@ -31,13 +31,16 @@ extern "C"
 
 #include <libtocc/front_end/file_info.h>
 
+#include "utilities.h"
+
 
 #define FILE_INFO_IS_NUM 0
 #define FILE_INFO_CREATE_NUM 1
 #define FILE_INFO_CREATE_LIST_NUM 2
 #define FILE_INFO_CREATE_FILE_IDS_NUM 3
 #define FILE_INFO_GET_NUM 4
-#define FILE_INFO_API_POINTERS 5
+#define FILE_INFO_CREATE_ITERATOR_NUM 5
+#define FILE_INFO_API_POINTERS 6
 
 
 #ifdef FILE_INFO_MODULE
@@ -47,8 +50,14 @@ bool is_python_file_info(PyObject* object);
 PyObject* create_python_file_info(const libtocc::FileInfo& file_info);
 PyObject* create_python_file_info_list(
       libtocc::FileInfoCollection& file_info_collection);
-bool create_file_ids_array(PyObject* files_list, char** out_array);
+bool create_file_ids_array(PyObject* files_list,
+                           libtocc_python::StringArena& arena,
+                           const char*** out_array,
+                           int* out_size);
 libtocc::FileInfo* python_file_info_get(PyObject* file_info);
+PyObject* create_python_file_info_iterator(
+      libtocc::FileInfoCollection* file_info_collection,
+      Py_ssize_t offset, Py_ssize_t limit);
 
 #else
 
@@ -62,7 +71,7 @@ static void** FileInfoAPI;
  * Checks if the specified Python Object is a FileInfo.
  */
 #define is_python_file_info \
-    (*(PyObject* (*)(PyObject* object)) FileInfoAPI[FILE_INFO_IS_NUM])
+    (*(bool (*)(PyObject* object)) FileInfoAPI[FILE_INFO_IS_NUM])
 
 /*
  * Creates a Python Object from the specified FileInfo.
@@ -77,18 +86,20 @@ static void** FileInfoAPI;
   (*(PyObject* (*)(libtocc::FileInfoCollection& file_info_collection)) FileInfoAPI[FILE_INFO_CREATE_LIST_NUM])
 
 /*
- * Creates a list of file IDs.
+ * Creates an array of file IDs.
  *
- * @param files_list: can be a list of Strings, or a list of FileInfo, or a list
- *   of both.
- * @param out_array: Array to fill. This method allocates memory for
- *   specified the pointer.
+ * @param files_list: A collection of str or FileInfo (or a mix of them).
+ *   It can be a list, a tuple, any iterable, or a buffer of packed IDs.
+ * @param arena: The array and the IDs are copied to this arena. They're
+ *   valid until the arena is destroyed, even if the GIL is released.
+ * @param out_array: Will point to the created array.
+ * @param out_size: Will be set to the size of the created array.
  *
  * @return: false if any errors happen.
  *   It sets the Python Error if error happen.
  */
 #define create_file_ids_array \
-  (*(bool (*)(PyObject* files_list, char** out_array)) FileInfoAPI[FILE_INFO_CREATE_FILE_IDS_NUM])
+  (*(bool (*)(PyObject* files_list, libtocc_python::StringArena& arena, const char*** out_array, int* out_size)) FileInfoAPI[FILE_INFO_CREATE_FILE_IDS_NUM])
 
 /*
  * Returns the internal pointer for the specified FileInfoObject.
@@ -98,6 +109,21 @@ static void** FileInfoAPI;
 #define python_file_info_get \
   (*(libtocc::FileInfo* (*)(PyObject* file_info)) FileInfoAPI[FILE_INFO_GET_NUM])
 
+/*
+ * Creates an iterator over the specified FileInfoCollection.
+ * Python FileInfo objects are created one by one, as the iterator
+ * advances.
+ *
+ * @param file_info_collection: Collection to iterate. The iterator takes
+ *   its ownership, and deletes it when it's destroyed. So it should be
+ *   allocated with `new'.
+ * @param offset: Number of items to skip from the start of the
+ *   collection. Skipped items are never converted.
+ * @param limit: Maximum number of items to return. -1 means no limit.
+ */
+#define create_python_file_info_iterator \
+  (*(PyObject* (*)(libtocc::FileInfoCollection* file_info_collection, Py_ssize_t offset, Py_ssize_t limit)) FileInfoAPI[FILE_INFO_CREATE_ITERATOR_NUM])
+
 extern "C"
 {
 /*
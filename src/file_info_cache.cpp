@@ -0,0 +1,204 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "file_info_cache.h"
+
+
+namespace libtocc_python
+{
+
+  FileInfoCache::FileInfoCache(size_t max_size)
+  {
+    this->max_size = max_size;
+    this->generation = 0;
+    this->hits = 0;
+    this->misses = 0;
+    this->evictions = 0;
+  }
+
+  FileInfoCache::~FileInfoCache()
+  {
+    clear();
+  }
+
+  PyObject* FileInfoCache::get_by_id(const char* file_id)
+  {
+    EntriesMap::iterator found = this->by_id.find(file_id);
+    if (found == this->by_id.end())
+    {
+      this->misses++;
+      return NULL;
+    }
+
+    return hit(found->second);
+  }
+
+  PyObject* FileInfoCache::get_by_traditional_path(const char* traditional_path)
+  {
+    EntriesMap::iterator found = this->by_traditional_path.find(traditional_path);
+    if (found == this->by_traditional_path.end())
+    {
+      this->misses++;
+      return NULL;
+    }
+
+    return hit(found->second);
+  }
+
+  unsigned long FileInfoCache::get_generation()
+  {
+    return this->generation;
+  }
+
+  void FileInfoCache::insert(unsigned long generation,
+                             const libtocc::FileInfo& file_info,
+                             PyObject* python_file_info)
+  {
+    if (generation != this->generation || this->max_size == 0)
+    {
+      // Something changed while the file was read.
+      return;
+    }
+
+    // It may be cached by another thread in the meanwhile.
+    EntriesMap::iterator found = this->by_id.find(file_info.get_id());
+    if (found != this->by_id.end())
+    {
+      remove(found->second);
+    }
+    const char* traditional_path = file_info.get_traditional_path();
+    if (traditional_path[0] != '\0')
+    {
+      found = this->by_traditional_path.find(traditional_path);
+      if (found != this->by_traditional_path.end())
+      {
+        remove(found->second);
+      }
+    }
+
+    if (this->entries.size() >= this->max_size)
+    {
+      remove(--this->entries.end());
+      this->evictions++;
+    }
+
+    Entry entry;
+    entry.file_info = python_file_info;
+    entry.file_id = file_info.get_id();
+    entry.traditional_path = traditional_path;
+    this->entries.push_front(entry);
+    Py_INCREF(python_file_info);
+
+    this->by_id[entry.file_id] = this->entries.begin();
+    if (!entry.traditional_path.empty())
+    {
+      this->by_traditional_path[entry.traditional_path] = this->entries.begin();
+    }
+  }
+
+  void FileInfoCache::invalidate_id(const char* file_id)
+  {
+    this->generation++;
+
+    EntriesMap::iterator found = this->by_id.find(file_id);
+    if (found != this->by_id.end())
+    {
+      remove(found->second);
+    }
+  }
+
+  void FileInfoCache::invalidate_traditional_path(const char* traditional_path)
+  {
+    this->generation++;
+
+    EntriesMap::iterator found = this->by_traditional_path.find(traditional_path);
+    if (found != this->by_traditional_path.end())
+    {
+      remove(found->second);
+    }
+  }
+
+  void FileInfoCache::clear()
+  {
+    this->generation++;
+
+    while (!this->entries.empty())
+    {
+      remove(this->entries.begin());
+    }
+  }
+
+  size_t FileInfoCache::get_size()
+  {
+    return this->entries.size();
+  }
+
+  size_t FileInfoCache::get_max_size()
+  {
+    return this->max_size;
+  }
+
+  unsigned long FileInfoCache::get_hits()
+  {
+    return this->hits;
+  }
+
+  unsigned long FileInfoCache::get_misses()
+  {
+    return this->misses;
+  }
+
+  unsigned long FileInfoCache::get_evictions()
+  {
+    return this->evictions;
+  }
+
+  PyObject* FileInfoCache::hit(EntriesList::iterator entry)
+  {
+    this->hits++;
+
+    // Iterators in the maps stay valid after splice.
+    this->entries.splice(this->entries.begin(), this->entries, entry);
+
+    Py_INCREF(entry->file_info);
+    return entry->file_info;
+  }
+
+  void FileInfoCache::remove(EntriesList::iterator entry)
+  {
+    this->by_id.erase(entry->file_id);
+    if (!entry->traditional_path.empty())
+    {
+      EntriesMap::iterator found =
+          this->by_traditional_path.find(entry->traditional_path);
+      // The path may belong to a newer entry.
+      if (found != this->by_traditional_path.end() && found->second == entry)
+      {
+        this->by_traditional_path.erase(found);
+      }
+    }
+
+    // Releasing the object after the entry is removed, since its
+    // destructor may run Python code.
+    PyObject* file_info = entry->file_info;
+    this->entries.erase(entry);
+    Py_DECREF(file_info);
+  }
+
+}
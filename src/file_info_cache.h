@@ -0,0 +1,149 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_FILE_INFO_CACHE_H_INCLUDED
+#define LIBTOCC_PYTHON_FILE_INFO_CACHE_H_INCLUDED
+
+extern "C"
+{
+#include <Python.h>
+}
+
+#include <libtocc/front_end/file_info.h>
+
+#include <list>
+#include <map>
+#include <string>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * A bounded LRU cache of Python FileInfo objects, looked up by file ID
+   * or by traditional path.
+   *
+   * It holds references to Python objects, so all of its methods should
+   * be called while the GIL is held.
+   *
+   * A lookup that misses goes to libtocc with the GIL released, so a
+   * mutation may run in between. To not cache a stale result, take the
+   * generation before the libtocc call and pass it to `insert': each
+   * invalidation changes the generation, and the insert is skipped.
+   */
+  class FileInfoCache
+  {
+  public:
+    /*
+     * @param max_size: Maximum number of the cached files.
+     */
+    FileInfoCache(size_t max_size);
+
+    ~FileInfoCache();
+
+    /*
+     * Returns a new reference to the cached FileInfo, or NULL if it's
+     * not cached. It doesn't set the Python Error.
+     */
+    PyObject* get_by_id(const char* file_id);
+
+    /*
+     * Same as above, looks up by traditional path.
+     */
+    PyObject* get_by_traditional_path(const char* traditional_path);
+
+    /*
+     * Returns the current generation. See class description.
+     */
+    unsigned long get_generation();
+
+    /*
+     * Caches the specified Python FileInfo.
+     *
+     * @param generation: Generation returned before the FileInfo was read.
+     * @param file_info: The libtocc FileInfo that `python_file_info' is
+     *   created from.
+     * @param python_file_info: The cache takes a new reference to it.
+     */
+    void insert(unsigned long generation,
+                const libtocc::FileInfo& file_info,
+                PyObject* python_file_info);
+
+    /*
+     * Removes the file with the specified ID, if it's cached.
+     */
+    void invalidate_id(const char* file_id);
+
+    /*
+     * Removes the files with the specified traditional path, and stops
+     * pending inserts of any path. Used when a new file is imported.
+     */
+    void invalidate_traditional_path(const char* traditional_path);
+
+    /*
+     * Removes all of the cached files.
+     */
+    void clear();
+
+    size_t get_size();
+    size_t get_max_size();
+    unsigned long get_hits();
+    unsigned long get_misses();
+    unsigned long get_evictions();
+
+  private:
+    struct Entry
+    {
+      PyObject* file_info;
+      std::string file_id;
+      // Empty if the file has no traditional path.
+      std::string traditional_path;
+    };
+    typedef std::list<Entry> EntriesList;
+    typedef std::map<std::string, EntriesList::iterator> EntriesMap;
+
+    // Cache is not copyable.
+    FileInfoCache(const FileInfoCache&);
+    FileInfoCache& operator=(const FileInfoCache&);
+
+    /*
+     * Moves the entry to the front of the list, and returns a new
+     * reference to its FileInfo.
+     */
+    PyObject* hit(EntriesList::iterator entry);
+
+    /*
+     * Removes the entry from the list and maps, and releases its FileInfo.
+     */
+    void remove(EntriesList::iterator entry);
+
+    // Most recently used entry is the first one.
+    EntriesList entries;
+    EntriesMap by_id;
+    EntriesMap by_traditional_path;
+    size_t max_size;
+    unsigned long generation;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+  };
+
+}
+
+#endif /* LIBTOCC_PYTHON_FILE_INFO_CACHE_H_INCLUDED */
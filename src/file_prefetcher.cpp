@@ -0,0 +1,127 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "file_prefetcher.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * How much of each file is read ahead. The kernel's own read-ahead
+   * continues from there when the file is copied, and huge files don't
+   * push the others out of the page cache.
+   */
+  static const off_t PREFETCH_SIZE = 16 * 1024 * 1024;
+
+  FilePrefetcher::FilePrefetcher(unsigned int threads_count)
+  {
+    this->next_sequence = 0;
+    this->consumed_sequence = 0;
+    this->stopped = false;
+
+    for (unsigned int i = 0; i < threads_count; i++)
+    {
+      this->threads.push_back(std::thread(&FilePrefetcher::work, this));
+    }
+  }
+
+  FilePrefetcher::~FilePrefetcher()
+  {
+    {
+      std::lock_guard<std::mutex> guard(this->queue_mutex);
+      this->stopped = true;
+      this->queue.clear();
+    }
+    this->queue_condition.notify_all();
+
+    for (size_t i = 0; i < this->threads.size(); i++)
+    {
+      this->threads[i].join();
+    }
+  }
+
+  void FilePrefetcher::prefetch(const std::string& path)
+  {
+    if (this->threads.empty())
+    {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(this->queue_mutex);
+      Job job;
+      job.path = path;
+      job.sequence = this->next_sequence++;
+      this->queue.push_back(job);
+    }
+    this->queue_condition.notify_one();
+  }
+
+  void FilePrefetcher::consumed()
+  {
+    std::lock_guard<std::mutex> guard(this->queue_mutex);
+    this->consumed_sequence++;
+  }
+
+  void FilePrefetcher::work()
+  {
+    while (true)
+    {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        while (!this->stopped &&
+               (this->queue.empty() ||
+                this->queue.front().sequence < this->consumed_sequence))
+        {
+          if (!this->queue.empty())
+          {
+            // It's already used. Prefetching it would be wasted.
+            this->queue.pop_front();
+            continue;
+          }
+          this->queue_condition.wait(lock);
+        }
+        if (this->stopped)
+        {
+          return;
+        }
+        job.path.swap(this->queue.front().path);
+        job.sequence = this->queue.front().sequence;
+        this->queue.pop_front();
+      }
+
+      // Errors are ignored: the file will be reported when it's imported.
+      int fd = open(job.path.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        continue;
+      }
+#ifdef POSIX_FADV_WILLNEED
+      posix_fadvise(fd, 0, PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+#endif
+      close(fd);
+    }
+  }
+
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_FILE_PREFETCHER_H_INCLUDED
+#define LIBTOCC_PYTHON_FILE_PREFETCHER_H_INCLUDED
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Reads files ahead of their use on a few native threads, so they're
+   * in the page cache when they're copied. It's useful when opening and
+   * reading each file is slow (e.g. many small files on a network share)
+   * and files have to be copied one by one.
+   *
+   * It doesn't touch any Python objects, so it can be used without the GIL.
+   */
+  class FilePrefetcher
+  {
+  public:
+    /*
+     * @param threads_count: Number of the worker threads. If it's zero,
+     *   nothing is prefetched.
+     */
+    FilePrefetcher(unsigned int threads_count);
+
+    /*
+     * Stops the threads. Files that are not prefetched yet are dropped.
+     */
+    ~FilePrefetcher();
+
+    /*
+     * Adds the file to the queue. Files should be added in the order
+     * they will be used.
+     */
+    void prefetch(const std::string& path);
+
+    /*
+     * Tells that the files added before the next one are used, so they
+     * shouldn't be prefetched anymore.
+     */
+    void consumed();
+
+  private:
+    struct Job
+    {
+      std::string path;
+      unsigned long sequence;
+    };
+
+    // Prefetcher is not copyable.
+    FilePrefetcher(const FilePrefetcher&);
+    FilePrefetcher& operator=(const FilePrefetcher&);
+
+    void work();
+
+    std::vector<std::thread> threads;
+    std::deque<Job> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    // Sequence of the next prefetched file, and the next used file.
+    unsigned long next_sequence;
+    unsigned long consumed_sequence;
+    bool stopped;
+  };
+
+}
+
+#endif /* LIBTOCC_PYTHON_FILE_PREFETCHER_H_INCLUDED */
@@ -0,0 +1,390 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "file_transfer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/syscall.h>
+#endif
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Size of the buffer used for copying through user space.
+   */
+  static const size_t COPY_BUFFER_SIZE = 1024 * 1024;
+
+  FileTransferError::FileTransferError(const std::string& path, int error_number)
+    : std::runtime_error(std::string(strerror(error_number)) + ": " + path)
+  {
+    this->path = path;
+    this->error_number = error_number;
+  }
+
+  FileTransferError::~FileTransferError() throw()
+  {
+  }
+
+  const std::string& FileTransferError::get_path() const
+  {
+    return this->path;
+  }
+
+  int FileTransferError::get_error_number() const
+  {
+    return this->error_number;
+  }
+
+  PlaceholderFile::PlaceholderFile()
+  {
+    const char* temp_dir = getenv("TMPDIR");
+    if (temp_dir == NULL || temp_dir[0] == '\0')
+    {
+      temp_dir = "/tmp";
+    }
+    std::string path_template = std::string(temp_dir) + "/libtocc-import-XXXXXX";
+
+    int fd = mkstemp(&path_template[0]);
+    if (fd < 0)
+    {
+      throw FileTransferError(path_template, errno);
+    }
+    close(fd);
+    this->path = path_template;
+  }
+
+  PlaceholderFile::~PlaceholderFile()
+  {
+    unlink(this->path.c_str());
+  }
+
+  const char* PlaceholderFile::get_path()
+  {
+    return this->path.c_str();
+  }
+
+  StagedFile::StagedFile(const std::string& directory)
+  {
+    std::string path_template = directory + "/.libtocc-python-import-XXXXXX";
+
+    int fd = mkstemp(&path_template[0]);
+    if (fd < 0)
+    {
+      throw FileTransferError(path_template, errno);
+    }
+    close(fd);
+    this->path = path_template;
+    this->committed = false;
+  }
+
+  StagedFile::~StagedFile()
+  {
+    if (!this->committed)
+    {
+      unlink(this->path.c_str());
+    }
+  }
+
+  const char* StagedFile::get_path()
+  {
+    return this->path.c_str();
+  }
+
+  void StagedFile::commit(const char* destination_path)
+  {
+    if (rename(this->path.c_str(), destination_path) == 0)
+    {
+      this->committed = true;
+      return;
+    }
+    if (errno != EXDEV)
+    {
+      throw FileTransferError(destination_path, errno);
+    }
+
+    // Managed file is on another file system (something is mounted
+    // inside the base path). The data is copied to a staged file beside
+    // it, so it's still replaced at once.
+    std::string destination(destination_path);
+    size_t separator = destination.rfind('/');
+    StagedFile copy(separator == std::string::npos ?
+                    std::string(".") : destination.substr(0, separator));
+    transfer_file(this->path.c_str(), copy.get_path(),
+                  IMPORT_MODE_COPY_FILE_RANGE);
+    copy.commit(destination_path);
+  }
+
+  /*
+   * Closes the file descriptor when it goes out of scope.
+   */
+  class FileDescriptor
+  {
+  public:
+    FileDescriptor(int fd)
+    {
+      this->fd = fd;
+    }
+
+    ~FileDescriptor()
+    {
+      if (this->fd >= 0)
+      {
+        close(this->fd);
+      }
+    }
+
+    int get()
+    {
+      return this->fd;
+    }
+
+  private:
+    int fd;
+  };
+
+  /*
+   * Writes all of the data.
+   *
+   * @return: 0 on success, or the errno.
+   */
+  static int write_data(int destination_fd, const char* data, size_t size)
+  {
+    size_t written = 0;
+    while (written < size)
+    {
+      ssize_t write_size = write(destination_fd, data + written, size - written);
+      if (write_size < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return errno;
+      }
+      written += write_size;
+    }
+    return 0;
+  }
+
+  /*
+   * Copies the data through user space, from the current positions.
+   *
+   * @return: 0 on success, or the errno.
+   */
+  static int copy_data(int source_fd, int destination_fd)
+  {
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(source_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    std::string buffer(COPY_BUFFER_SIZE, '\0');
+    while (true)
+    {
+      ssize_t read_size = read(source_fd, &buffer[0], buffer.size());
+      if (read_size < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return errno;
+      }
+      if (read_size == 0)
+      {
+        return 0;
+      }
+
+      int error_number = write_data(destination_fd, &buffer[0], read_size);
+      if (error_number != 0)
+      {
+        return error_number;
+      }
+    }
+  }
+
+  /*
+   * Copies the data inside the kernel.
+   *
+   * @return: 0 on success, or the errno.
+   */
+  static int copy_data_in_kernel(int source_fd, int destination_fd)
+  {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    while (true)
+    {
+      ssize_t copied = syscall(SYS_copy_file_range, source_fd, NULL,
+                               destination_fd, NULL, (size_t)1 << 30, 0);
+      if (copied < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return errno;
+      }
+      if (copied == 0)
+      {
+        return 0;
+      }
+    }
+#else
+    return ENOSYS;
+#endif
+  }
+
+  /*
+   * Makes the destination share the source's blocks.
+   *
+   * @return: 0 on success, or the errno.
+   */
+  static int clone_data(int source_fd, int destination_fd)
+  {
+#ifdef FICLONE
+    if (ioctl(destination_fd, FICLONE, source_fd) != 0)
+    {
+      return errno;
+    }
+    return 0;
+#else
+    return EOPNOTSUPP;
+#endif
+  }
+
+  /*
+   * Replaces the destination with a hard link to the source.
+   *
+   * @return: 0 on success, or the errno.
+   */
+  static int link_file(const char* source_path, const char* destination_path)
+  {
+    // Link can't replace a file, so it's created beside the destination,
+    // and then renamed over it.
+    std::string link_path = std::string(destination_path) + ".link";
+    unlink(link_path.c_str());
+    if (link(source_path, link_path.c_str()) != 0)
+    {
+      return errno;
+    }
+    if (rename(link_path.c_str(), destination_path) != 0)
+    {
+      int error_number = errno;
+      unlink(link_path.c_str());
+      return error_number;
+    }
+    return 0;
+  }
+
+  void transfer_file(const char* source_path, const char* destination_path,
+                     ImportMode mode)
+  {
+    if (mode == IMPORT_MODE_HARDLINK || mode == IMPORT_MODE_MOVE)
+    {
+      if (link_file(source_path, destination_path) == 0)
+      {
+        return;
+      }
+    }
+
+    FileDescriptor source_fd(open(source_path, O_RDONLY));
+    if (source_fd.get() < 0)
+    {
+      throw FileTransferError(source_path, errno);
+    }
+    FileDescriptor destination_fd(open(destination_path, O_WRONLY | O_TRUNC));
+    if (destination_fd.get() < 0)
+    {
+      throw FileTransferError(destination_path, errno);
+    }
+
+    int error_number = -1;
+    if (mode == IMPORT_MODE_REFLINK)
+    {
+      error_number = clone_data(source_fd.get(), destination_fd.get());
+    }
+    if (error_number != 0 &&
+        (mode == IMPORT_MODE_REFLINK || mode == IMPORT_MODE_COPY_FILE_RANGE))
+    {
+      error_number = copy_data_in_kernel(source_fd.get(), destination_fd.get());
+    }
+    if (error_number != 0)
+    {
+      // Falling back to a plain copy, from the start. If the source is
+      // a pipe (it can't seek), nothing is read from it yet.
+      if ((lseek(source_fd.get(), 0, SEEK_SET) < 0 && errno != ESPIPE) ||
+          ftruncate(destination_fd.get(), 0) != 0 ||
+          lseek(destination_fd.get(), 0, SEEK_SET) < 0)
+      {
+        throw FileTransferError(destination_path, errno);
+      }
+      error_number = copy_data(source_fd.get(), destination_fd.get());
+      if (error_number != 0)
+      {
+        throw FileTransferError(source_path, error_number);
+      }
+    }
+  }
+
+  void write_file(const char* destination_path, const char* data, size_t size)
+  {
+    FileDescriptor destination_fd(open(destination_path, O_WRONLY | O_TRUNC));
+    if (destination_fd.get() < 0)
+    {
+      throw FileTransferError(destination_path, errno);
+    }
+
+    int error_number = write_data(destination_fd.get(), data, size);
+    if (error_number != 0)
+    {
+      throw FileTransferError(destination_path, error_number);
+    }
+  }
+
+  void transfer_fd(int source_fd, const char* destination_path)
+  {
+    FileDescriptor destination_fd(open(destination_path, O_WRONLY | O_TRUNC));
+    if (destination_fd.get() < 0)
+    {
+      throw FileTransferError(destination_path, errno);
+    }
+
+    if (copy_data_in_kernel(source_fd, destination_fd.get()) == 0)
+    {
+      return;
+    }
+    // Both positions are moved by what's copied so far (if any), so the
+    // rest is copied from there.
+    int error_number = copy_data(source_fd, destination_fd.get());
+    if (error_number != 0)
+    {
+      throw FileTransferError(destination_path, error_number);
+    }
+  }
+
+}
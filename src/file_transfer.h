@@ -0,0 +1,179 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_FILE_TRANSFER_H_INCLUDED
+#define LIBTOCC_PYTHON_FILE_TRANSFER_H_INCLUDED
+
+#include <stddef.h>
+
+#include <stdexcept>
+#include <string>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * How contents of an imported file get into the base path.
+   */
+  enum ImportMode
+  {
+    // libtocc copies the file itself.
+    IMPORT_MODE_COPY,
+    // The managed file is a hard link to the source.
+    IMPORT_MODE_HARDLINK,
+    // The managed file shares the source's blocks (FICLONE), on file
+    // systems that support it (Btrfs, XFS, ...).
+    IMPORT_MODE_REFLINK,
+    // Data is copied inside the kernel, with copy_file_range.
+    IMPORT_MODE_COPY_FILE_RANGE,
+    // The managed file is a hard link to the source (or a copy, if
+    // they're on different file systems), and the source is removed once
+    // the file is imported.
+    IMPORT_MODE_MOVE
+  };
+
+  /*
+   * Thrown if contents of a file couldn't be transferred.
+   */
+  class FileTransferError : public std::runtime_error
+  {
+  public:
+    FileTransferError(const std::string& path, int error_number);
+
+    virtual ~FileTransferError() throw();
+
+    const std::string& get_path() const;
+
+    int get_error_number() const;
+
+  private:
+    std::string path;
+    int error_number;
+  };
+
+  /*
+   * An empty temporary file. It's imported in place of the source file,
+   * so libtocc doesn't copy the data, and then the contents (see
+   * StagedFile) are moved to the managed file.
+   * The file is removed when the object is destroyed.
+   */
+  class PlaceholderFile
+  {
+  public:
+    /*
+     * @throw FileTransferError: if the file couldn't be created.
+     */
+    PlaceholderFile();
+
+    ~PlaceholderFile();
+
+    const char* get_path();
+
+  private:
+    // Placeholder is not copyable.
+    PlaceholderFile(const PlaceholderFile&);
+    PlaceholderFile& operator=(const PlaceholderFile&);
+
+    std::string path;
+  };
+
+  /*
+   * A temporary file in the base path, that contents of an imported file
+   * are written to before the file is imported. Writing doesn't need the
+   * Manager's lock, and since it's on the same file system as the managed
+   * files, it can be renamed over its managed file at the end, so a
+   * partly written file is never visible.
+   * The file is removed when the object is destroyed, unless it's
+   * committed.
+   */
+  class StagedFile
+  {
+  public:
+    /*
+     * Creates an empty file with a unique name in the directory.
+     *
+     * @throw FileTransferError: if the file couldn't be created.
+     */
+    StagedFile(const std::string& directory);
+
+    ~StagedFile();
+
+    const char* get_path();
+
+    /*
+     * Moves the file to the destination, replacing it. If they're not on
+     * the same file system, the data is copied to a new staged file in
+     * the destination's directory, and that one is moved instead. Either
+     * way, the destination is replaced at once.
+     *
+     * @throw FileTransferError: if the file couldn't be moved.
+     */
+    void commit(const char* destination_path);
+
+  private:
+    // Staged file is not copyable.
+    StagedFile(const StagedFile&);
+    StagedFile& operator=(const StagedFile&);
+
+    std::string path;
+    bool committed;
+  };
+
+  /*
+   * Replaces contents of the destination with the source's, using the
+   * specified mode. If the mode isn't possible (e.g. files are on
+   * different file systems, or the file system doesn't support it), it
+   * falls back to copying the data.
+   *
+   * Doesn't touch any Python objects, so it can be called without the GIL.
+   *
+   * With IMPORT_MODE_MOVE the source isn't removed: the caller removes
+   * it when the file is imported, so it's not lost if the import fails.
+   *
+   * @param destination_path: An existing (empty) file.
+   *
+   * @throw FileTransferError: if the data couldn't be transferred.
+   */
+  void transfer_file(const char* source_path, const char* destination_path,
+                     ImportMode mode);
+
+  /*
+   * Replaces contents of the destination with the data.
+   *
+   * Doesn't touch any Python objects, so it can be called without the GIL.
+   *
+   * @throw FileTransferError: if the data couldn't be written.
+   */
+  void write_file(const char* destination_path, const char* data, size_t size);
+
+  /*
+   * Replaces contents of the destination with the rest of the source
+   * descriptor, from its current position. The source can be a pipe or a
+   * socket as well. It isn't closed.
+   *
+   * Doesn't touch any Python objects, so it can be called without the GIL.
+   *
+   * @throw FileTransferError: if the data couldn't be transferred.
+   */
+  void transfer_fd(int source_fd, const char* destination_path);
+
+}
+
+#endif /* LIBTOCC_PYTHON_FILE_TRANSFER_H_INCLUDED */
@@ -23,11 +23,38 @@ extern "C"
 }
 
 #include "utilities.h"
+#include "file_info_cache.h"
+#include "tags_table.h"
+#include "worker_pool.h"
+#include "edit_batch.h"
+#include "directory_walker.h"
+#include "file_prefetcher.h"
+#include "file_transfer.h"
+#include "dedup_index.h"
 // `file_info' module.
 #include "file_info.h"
+// `query' module.
+#include "query.h"
 
 #include <libtocc/front_end/manager.h>
 #include <libtocc/common/base_exception.h>
+#include <libtocc/common/database_exceptions.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 /*
@@ -37,468 +64,4381 @@ typedef struct
 {
   PyObject_HEAD
   libtocc::Manager* manager_instance;
+  /*
+   * libtocc calls run without the GIL. This lock prevents concurrent
+   * Python threads from using the same libtocc::Manager at once.
+   */
+  PyThread_type_lock lock;
+  /*
+   * Recently used files. NULL if caching is disabled.
+   */
+  libtocc_python::FileInfoCache* file_info_cache;
+  /*
+   * Number of files of each tag. NULL if tracking tags is disabled.
+   * It's guarded by `lock', not the GIL.
+   */
+  libtocc_python::TagsTable* tags_table;
+  /*
+   * Hashes of the files imported with dedup. It's guarded by `lock'.
+   */
+  libtocc_python::DedupIndex* dedup_index;
+  /*
+   * Base path of the libtocc Manager. Contents of the imported files are
+   * staged there. It's guarded by `lock'.
+   */
+  std::string* base_path;
+  /*
+   * Edits of the active `batch()' of each thread, by thread ID. Calls of
+   * a thread are queued only in its own batch. It's guarded by the GIL,
+   * and it's NULL until the first batch is entered.
+   */
+  std::map<unsigned long, libtocc_python::EditBatch*>* active_batches;
 } ManagerObject;
 
 
 /*
- * __init__ method.
+ * Parameters of the Manager's constructor.
+ */
+static const char* manager_init_kwlist[] = { "base_path", "cache_size",
+                                             "track_tags", NULL };
+
+/*
+ * Initializes the Manager object with the unpacked constructor arguments.
+ * Shared by __init__ and the vectorcall constructor.
+ *
+ * @return: 0 on success, -1 on error. It sets the Python Error.
+ */
+static int manager_init_with_args(ManagerObject* self, PyObject** values)
+{
+  const char* base_path = libtocc_python::python_unicode_to_char(values[0]);
+  if (base_path == NULL)
+  {
+    return -1;
+  }
+  Py_ssize_t cache_size = 0;
+  if (values[1] != NULL && !libtocc_python::python_to_ssize_t(values[1], &cache_size))
+  {
+    return -1;
+  }
+  if (cache_size < 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "cache_size can't be negative.");
+    return -1;
+  }
+  int track_tags = 0;
+  if (values[2] != NULL)
+  {
+    track_tags = PyObject_IsTrue(values[2]);
+    if (track_tags < 0)
+    {
+      return -1;
+    }
+  }
+
+  if (self->lock == NULL)
+  {
+    self->lock = PyThread_allocate_lock();
+    if (self->lock == NULL)
+    {
+      PyErr_NoMemory();
+      return -1;
+    }
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+
+    if (self->manager_instance != NULL)
+    {
+      delete self->manager_instance;
+    }
+    self->manager_instance = new libtocc::Manager(base_path);
+
+    delete self->base_path;
+    self->base_path = new std::string(base_path);
+
+    // Index is loaded on its first use.
+    delete self->dedup_index;
+    self->dedup_index = new libtocc_python::DedupIndex(
+        std::string(base_path) + "/.libtocc-python-dedup");
+
+    // Table is seeded on its first use.
+    delete self->tags_table;
+    self->tags_table = NULL;
+    if (track_tags)
+    {
+      self->tags_table = new libtocc_python::TagsTable();
+    }
+  }
+  catch (libtocc::BaseException& error)
+  {
+    self->manager_instance = NULL;
+    libtocc_python::set_libtocc_error(error);
+    return -1;
+  }
+
+  // A new base path, so files of the old one shouldn't be returned.
+  delete self->file_info_cache;
+  self->file_info_cache = NULL;
+  if (cache_size > 0)
+  {
+    self->file_info_cache = new libtocc_python::FileInfoCache(cache_size);
+  }
+
+  return 0;
+}
+
+/*
+ * __init__ method.
+ */
+static int manager_init(ManagerObject* self, PyObject* args, PyObject* kwargs)
+{
+  PyObject* values[3];
+  if (!libtocc_python::unpack_tuple_args("Manager", args, kwargs,
+                                         manager_init_kwlist, 1, values))
+  {
+    return -1;
+  }
+
+  return manager_init_with_args(self, values);
+}
+
+#if PY_VERSION_HEX >= 0x03090000
+/*
+ * Vectorcall constructor. Calling `Manager(...)' comes here directly,
+ * without packing the arguments into a tuple and a dict.
+ */
+static PyObject* manager_vectorcall(PyObject* type, PyObject* const* args,
+                                    size_t nargsf, PyObject* kwnames)
+{
+  PyObject* values[3];
+  if (!libtocc_python::unpack_fastcall_args("Manager", args,
+                                            PyVectorcall_NARGS(nargsf), kwnames,
+                                            manager_init_kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  PyTypeObject* manager_type = (PyTypeObject*)type;
+  PyObject* self = manager_type->tp_alloc(manager_type, 0);
+  if (self == NULL)
+  {
+    return NULL;
+  }
+
+  if (manager_init_with_args((ManagerObject*)self, values) < 0)
+  {
+    Py_DECREF(self);
+    return NULL;
+  }
+
+  return self;
+}
+#endif
+
+/*
+ * Destructor.
+ */
+static void manager_object_dealloc(ManagerObject* self)
+{
+  if (self->manager_instance != NULL)
+  {
+    delete self->manager_instance;
+    self->manager_instance = NULL;
+  }
+  if (self->lock != NULL)
+  {
+    PyThread_free_lock(self->lock);
+    self->lock = NULL;
+  }
+  delete self->file_info_cache;
+  self->file_info_cache = NULL;
+  delete self->tags_table;
+  self->tags_table = NULL;
+  delete self->dedup_index;
+  self->dedup_index = NULL;
+  delete self->base_path;
+  self->base_path = NULL;
+  // Batches keep a reference to the Manager, so none of them is active.
+  delete self->active_batches;
+  self->active_batches = NULL;
+  PyObject_Del(self);
+}
+
+/*
+ * Removes the specified files from the cache, if caching is enabled.
+ * It should be called after the libtocc call that changed the files
+ * (even if it failed), so a lookup that ran concurrently can't cache
+ * their old state.
+ */
+static void manager_invalidate_files(ManagerObject* self,
+                                     libtocc::FileInfoCollection& files)
+{
+  if (self->file_info_cache == NULL)
+  {
+    return;
+  }
+
+  libtocc::FileInfoCollection::Iterator iterator(&files);
+  for (; !iterator.is_finished(); iterator.next())
+  {
+    self->file_info_cache->invalidate_id(iterator.get()->get_id());
+  }
+}
+
+/*
+ * Same as above, for an array of IDs.
+ */
+static void manager_invalidate_files(ManagerObject* self,
+                                     const char** file_ids, int file_ids_size)
+{
+  if (self->file_info_cache == NULL)
+  {
+    return;
+  }
+
+  for (int i = 0; i < file_ids_size; i++)
+  {
+    self->file_info_cache->invalidate_id(file_ids[i]);
+  }
+}
+
+/*
+ * Removes files with the specified traditional path from the cache, if
+ * caching is enabled. Called after a file is imported.
+ */
+static void manager_invalidate_traditional_path(ManagerObject* self,
+                                                const char* traditional_path)
+{
+  if (self->file_info_cache != NULL && traditional_path[0] != '\0')
+  {
+    self->file_info_cache->invalidate_traditional_path(traditional_path);
+  }
+}
+
+/*
+ * Returns number of the distinct files in the collection.
+ */
+static unsigned int count_distinct_files(libtocc::FileInfoCollection& files)
+{
+  std::set<std::string> file_ids;
+
+  libtocc::FileInfoCollection::Iterator iterator(&files);
+  for (; !iterator.is_finished(); iterator.next())
+  {
+    file_ids.insert(iterator.get()->get_id());
+  }
+
+  return file_ids.size();
+}
+
+/*
+ * The `manager_locked_' functions make a libtocc call, and keep the tags
+ * table up to date. They should be called while the lock is held and the
+ * GIL is released, so both the blocking methods and the async tasks can
+ * use them.
+ *
+ * They throw libtocc exceptions.
+ */
+
+/*
+ * Options of the import methods.
+ */
+struct ImportOptions
+{
+  libtocc_python::ImportMode import_mode;
+  // If true, a file that its contents are already imported isn't stored
+  // again.
+  bool dedup;
+};
+
+/*
+ * Writes contents of a file that's going to be imported. It's called
+ * while the GIL is released, and the lock isn't held.
+ */
+class ContentWriter
+{
+public:
+  virtual ~ContentWriter()
+  {
+  }
+
+  /*
+   * @throw FileTransferError: if the contents couldn't be written.
+   */
+  virtual void write(const char* destination_path) = 0;
+};
+
+/*
+ * Transfers a source file with one of the import modes.
+ */
+class SourceFileWriter : public ContentWriter
+{
+public:
+  SourceFileWriter(const char* source_path, libtocc_python::ImportMode import_mode)
+  {
+    this->source_path = source_path;
+    this->import_mode = import_mode;
+  }
+
+  virtual void write(const char* destination_path)
+  {
+    libtocc_python::transfer_file(this->source_path, destination_path,
+                                  this->import_mode);
+  }
+
+private:
+  const char* source_path;
+  libtocc_python::ImportMode import_mode;
+};
+
+/*
+ * Writes data from memory.
+ */
+class BufferWriter : public ContentWriter
+{
+public:
+  BufferWriter(const char* data, size_t size)
+  {
+    this->data = data;
+    this->size = size;
+  }
+
+  virtual void write(const char* destination_path)
+  {
+    libtocc_python::write_file(destination_path, this->data, this->size);
+  }
+
+private:
+  const char* data;
+  size_t size;
+};
+
+/*
+ * Copies the rest of a file descriptor.
+ */
+class DescriptorWriter : public ContentWriter
+{
+public:
+  DescriptorWriter(int fd)
+  {
+    this->fd = fd;
+  }
+
+  virtual void write(const char* destination_path)
+  {
+    libtocc_python::transfer_fd(this->fd, destination_path);
+  }
+
+private:
+  int fd;
+};
+
+static void manager_locked_assign_tags(ManagerObject* self,
+                                       libtocc::FileInfoCollection& file_infos,
+                                       libtocc::TagsCollection* tags)
+{
+  libtocc_python::TagsTableGuard tags_guard(self->tags_table);
+
+  libtocc::TagStatisticsCollection before;
+  if (tags_guard.get() != NULL)
+  {
+    before = self->manager_instance->get_tags_statistics(file_infos);
+  }
+  self->manager_instance->assign_tags(file_infos, tags);
+  if (tags_guard.get() != NULL)
+  {
+    tags_guard.get()->assigned(before, *tags, count_distinct_files(file_infos));
+  }
+  tags_guard.commit();
+}
+
+static void manager_locked_unassign_tags(ManagerObject* self,
+                                         libtocc::FileInfoCollection& file_infos,
+                                         libtocc::TagsCollection* tags)
+{
+  libtocc_python::TagsTableGuard tags_guard(self->tags_table);
+
+  libtocc::TagStatisticsCollection before;
+  if (tags_guard.get() != NULL)
+  {
+    before = self->manager_instance->get_tags_statistics(file_infos);
+  }
+  self->manager_instance->unassign_tags(file_infos, tags);
+  if (tags_guard.get() != NULL)
+  {
+    tags_guard.get()->unassigned(before, *tags);
+  }
+  tags_guard.commit();
+}
+
+/*
+ * Finds the imported files that have the same hash as the source.
+ * Hashes may collide, so their contents should be compared before
+ * they're trusted.
+ *
+ * @param out_candidates: Pairs of (ID, physical path) of the files.
+ */
+static void manager_locked_find_duplicates(
+    ManagerObject* self,
+    const libtocc_python::ContentHash& content_hash,
+    std::vector<std::pair<std::string, std::string> >& out_candidates)
+{
+  std::vector<std::string> file_ids;
+  self->dedup_index->find(content_hash, file_ids);
+
+  for (size_t i = 0; i < file_ids.size(); i++)
+  {
+    try
+    {
+      libtocc::FileInfo candidate =
+          self->manager_instance->get_file_info(file_ids[i].c_str());
+      out_candidates.push_back(
+          std::make_pair(file_ids[i], std::string(candidate.get_physical_path())));
+    }
+    catch (libtocc::DatabaseScriptLogicalError&)
+    {
+      // It's removed.
+      self->dedup_index->remove(content_hash, file_ids[i]);
+    }
+  }
+}
+
+/*
+ * Imports an empty placeholder, and then moves the staged file over the
+ * managed one, so libtocc doesn't copy any data, and other threads never
+ * see a partly written file. If the staged file can't be moved, the
+ * imported file is removed.
+ *
+ * It also throws FileTransferError.
+ */
+static libtocc::FileInfo manager_locked_commit_staged_file(ManagerObject* self,
+                                                           libtocc_python::StagedFile& staged_file,
+                                                           const char* title,
+                                                           const char* traditional_path,
+                                                           libtocc::TagsCollection* tags)
+{
+  libtocc_python::TagsTableGuard tags_guard(self->tags_table);
+
+  libtocc_python::PlaceholderFile placeholder;
+  libtocc::FileInfo result =
+      self->manager_instance->import_file(placeholder.get_path(), title,
+                                          traditional_path, tags);
+  try
+  {
+    staged_file.commit(result.get_physical_path());
+  }
+  catch (libtocc_python::FileTransferError& error)
+  {
+    self->manager_instance->remove_file(result.get_id());
+    throw;
+  }
+
+  if (tags_guard.get() != NULL)
+  {
+    tags_guard.get()->imported(result);
+  }
+  tags_guard.commit();
+
+  return result;
+}
+
+/*
+ * Assigns the tags of a new file to the file that has the same contents.
+ *
+ * @return: false if the duplicate is removed since it's found. Then it's
+ *   removed from the index too.
+ */
+static bool manager_locked_reuse_duplicate(ManagerObject* self,
+                                           const libtocc_python::ContentHash& content_hash,
+                                           const std::string& duplicate_id,
+                                           libtocc::TagsCollection* tags)
+{
+  try
+  {
+    self->manager_instance->get_file_info(duplicate_id.c_str());
+  }
+  catch (libtocc::DatabaseScriptLogicalError&)
+  {
+    self->dedup_index->remove(content_hash, duplicate_id);
+    return false;
+  }
+
+  if (tags != NULL)
+  {
+    libtocc::FileInfoCollection file_infos(1);
+    file_infos.add_file_info(libtocc::FileInfo(duplicate_id.c_str()));
+    manager_locked_assign_tags(self, file_infos, tags);
+  }
+  return true;
+}
+
+/*
+ * Adds the newly stored file to the dedup index.
+ */
+static void manager_locked_index_file(ManagerObject* self,
+                                      const libtocc_python::ContentHash& content_hash,
+                                      const char* file_id)
+{
+  try
+  {
+    self->dedup_index->add(content_hash, file_id);
+  }
+  catch (libtocc_python::FileTransferError&)
+  {
+    // File is imported anyway. It just won't be found as a duplicate.
+  }
+}
+
+/*
+ * The `manager_unlocked_' functions are called while the GIL is released,
+ * but the lock isn't held. They take the lock only around the libtocc
+ * calls, so reading and writing the contents of files don't block the
+ * other calls of the Manager.
+ *
+ * They throw libtocc exceptions and FileTransferError.
+ */
+
+/*
+ * Creates an empty staged file in the base path.
+ */
+static libtocc_python::StagedFile* manager_unlocked_create_staged_file(ManagerObject* self)
+{
+  std::string staging_directory;
+  {
+    libtocc_python::LockHolder lock_holder(self->lock);
+    staging_directory = *self->base_path;
+  }
+  return new libtocc_python::StagedFile(staging_directory);
+}
+
+/*
+ * Writes the contents to a staged file without the lock, and then takes
+ * the lock to import it (see `manager_locked_commit_staged_file').
+ */
+static libtocc::FileInfo manager_unlocked_store_content(ManagerObject* self,
+                                                        const char* title,
+                                                        const char* traditional_path,
+                                                        libtocc::TagsCollection* tags,
+                                                        ContentWriter& writer)
+{
+  std::unique_ptr<libtocc_python::StagedFile> staged_file(
+      manager_unlocked_create_staged_file(self));
+  writer.write(staged_file->get_path());
+
+  libtocc_python::LockHolder lock_holder(self->lock);
+  return manager_locked_commit_staged_file(self, *staged_file, title,
+                                           traditional_path, tags);
+}
+
+/*
+ * Transfers the source to a new staged file, with one of the import
+ * modes other than `copy'.
+ */
+static libtocc_python::StagedFile* manager_unlocked_stage_file(ManagerObject* self,
+                                                               const char* source_path,
+                                                               libtocc_python::ImportMode import_mode)
+{
+  // Common errors are found before anything is written.
+  if (access(source_path, R_OK) != 0)
+  {
+    throw libtocc_python::FileTransferError(source_path, errno);
+  }
+
+  std::unique_ptr<libtocc_python::StagedFile> staged_file(
+      manager_unlocked_create_staged_file(self));
+  SourceFileWriter writer(source_path, import_mode);
+  writer.write(staged_file->get_path());
+
+  return staged_file.release();
+}
+
+/*
+ * Stores the file with libtocc.
+ *
+ * If the import mode is `copy', libtocc copies the file itself, while the
+ * lock is held. Otherwise, the source is transferred to a staged file
+ * without the lock.
+ */
+static libtocc::FileInfo manager_unlocked_store_file(ManagerObject* self,
+                                                     const char* source_path,
+                                                     const char* title,
+                                                     const char* traditional_path,
+                                                     libtocc::TagsCollection* tags,
+                                                     libtocc_python::ImportMode import_mode)
+{
+  if (import_mode == libtocc_python::IMPORT_MODE_COPY)
+  {
+    libtocc_python::LockHolder lock_holder(self->lock);
+    libtocc_python::TagsTableGuard tags_guard(self->tags_table);
+
+    // If there's no tags, collection is NULL, and libtocc won't assign
+    // any tags.
+    libtocc::FileInfo result =
+        self->manager_instance->import_file(source_path, title,
+                                            traditional_path, tags);
+    if (tags_guard.get() != NULL)
+    {
+      tags_guard.get()->imported(result);
+    }
+    tags_guard.commit();
+
+    return result;
+  }
+
+  std::unique_ptr<libtocc_python::StagedFile> staged_file(
+      manager_unlocked_stage_file(self, source_path, import_mode));
+  libtocc_python::LockHolder lock_holder(self->lock);
+  libtocc::FileInfo result =
+      manager_locked_commit_staged_file(self, *staged_file, title,
+                                        traditional_path, tags);
+
+  if (import_mode == libtocc_python::IMPORT_MODE_MOVE)
+  {
+    // If it can't be removed, it's kept: the file is imported anyway.
+    unlink(source_path);
+  }
+
+  return result;
+}
+
+/*
+ * Finds an imported file with the same contents as the source. Reading
+ * the source and the candidates doesn't need the lock, only the index
+ * does.
+ *
+ * @return: false if there's no such file.
+ */
+static bool manager_unlocked_find_duplicate(ManagerObject* self,
+                                            const char* source_path,
+                                            const libtocc_python::ContentHash& content_hash,
+                                            std::string& out_duplicate_id)
+{
+  std::vector<std::pair<std::string, std::string> > candidates;
+  {
+    libtocc_python::LockHolder lock_holder(self->lock);
+    manager_locked_find_duplicates(self, content_hash, candidates);
+  }
+
+  for (size_t i = 0; i < candidates.size(); i++)
+  {
+    if (libtocc_python::files_equal(source_path, candidates[i].second.c_str()))
+    {
+      out_duplicate_id.swap(candidates[i].first);
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Imports the file. With dedup, if the same contents are already
+ * imported, the new tags are assigned to the existing file, and it's
+ * returned instead.
+ */
+static libtocc::FileInfo manager_unlocked_import_file(ManagerObject* self,
+                                                      const char* source_path,
+                                                      const char* title,
+                                                      const char* traditional_path,
+                                                      libtocc::TagsCollection* tags,
+                                                      const ImportOptions& options)
+{
+  if (!options.dedup)
+  {
+    return manager_unlocked_store_file(self, source_path, title, traditional_path,
+                                       tags, options.import_mode);
+  }
+
+  libtocc_python::ContentHash content_hash = libtocc_python::hash_file(source_path);
+
+  std::string duplicate_id;
+  if (manager_unlocked_find_duplicate(self, source_path, content_hash, duplicate_id))
+  {
+    libtocc_python::LockHolder lock_holder(self->lock);
+    if (manager_locked_reuse_duplicate(self, content_hash, duplicate_id, tags))
+    {
+      if (options.import_mode == libtocc_python::IMPORT_MODE_MOVE)
+      {
+        // Its contents are stored already.
+        unlink(source_path);
+      }
+      return self->manager_instance->get_file_info(duplicate_id.c_str());
+    }
+  }
+
+  libtocc::FileInfo result =
+      manager_unlocked_store_file(self, source_path, title, traditional_path,
+                                  tags, options.import_mode);
+
+  libtocc_python::LockHolder lock_holder(self->lock);
+  manager_locked_index_file(self, content_hash, result.get_id());
+  return result;
+}
+
+/*
+ * Applies the edits of the batch, with a few bulk libtocc calls.
+ * Files with the same edits are changed by the same call.
+ *
+ * Adds number of the calls to the batch's counter.
+ */
+static void manager_locked_apply_batch(ManagerObject* self,
+                                       libtocc_python::EditBatch& batch)
+{
+  std::vector<libtocc_python::EditBatch::TagsEditGroup> tags_groups;
+  batch.get_tags_groups(tags_groups);
+
+  for (size_t i = 0; i < tags_groups.size(); i++)
+  {
+    libtocc_python::EditBatch::TagsEditGroup& group = tags_groups[i];
+
+    libtocc::FileInfoCollection file_infos(group.file_ids.size());
+    for (size_t j = 0; j < group.file_ids.size(); j++)
+    {
+      file_infos.add_file_info(libtocc::FileInfo(group.file_ids[j]));
+    }
+
+    if (!group.assigned_tags.empty())
+    {
+      libtocc::TagsCollection tags(group.assigned_tags.size());
+      for (size_t j = 0; j < group.assigned_tags.size(); j++)
+      {
+        tags.add_tag(group.assigned_tags[j]);
+      }
+      batch.add_calls(1);
+      manager_locked_assign_tags(self, file_infos, &tags);
+    }
+    if (!group.unassigned_tags.empty())
+    {
+      libtocc::TagsCollection tags(group.unassigned_tags.size());
+      for (size_t j = 0; j < group.unassigned_tags.size(); j++)
+      {
+        tags.add_tag(group.unassigned_tags[j]);
+      }
+      batch.add_calls(1);
+      manager_locked_unassign_tags(self, file_infos, &tags);
+    }
+  }
+
+  std::vector<libtocc_python::EditBatch::TitleGroup> title_groups;
+  batch.get_title_groups(title_groups);
+
+  for (size_t i = 0; i < title_groups.size(); i++)
+  {
+    libtocc_python::EditBatch::TitleGroup& group = title_groups[i];
+    batch.add_calls(1);
+    self->manager_instance->set_titles(&group.file_ids[0], (int)group.file_ids.size(),
+                                       group.title);
+  }
+}
+
+/*
+ * Returns the active batch, if the current thread entered one.
+ * Otherwise, returns NULL, and the edit should run immediately.
+ */
+static libtocc_python::EditBatch* manager_get_batch(ManagerObject* self)
+{
+  if (self->active_batches == NULL)
+  {
+    return NULL;
+  }
+  std::map<unsigned long, libtocc_python::EditBatch*>::iterator found =
+      self->active_batches->find(PyThread_get_thread_ident());
+  if (found == self->active_batches->end())
+  {
+    return NULL;
+  }
+  return found->second;
+}
+
+/*
+ * Adds edits of the tags of the files to the batch.
+ */
+static void batch_edit_tags(libtocc_python::EditBatch& batch,
+                            libtocc::FileInfoCollection& file_infos,
+                            libtocc::TagsCollection& tags, bool assign)
+{
+  libtocc::FileInfoCollection::Iterator files_iterator(&file_infos);
+  for (; !files_iterator.is_finished(); files_iterator.next())
+  {
+    libtocc::TagsCollection::Iterator tags_iterator(&tags);
+    for (; !tags_iterator.is_finished(); tags_iterator.next())
+    {
+      batch.edit_tag(files_iterator.get()->get_id(), tags_iterator.get(), assign);
+    }
+  }
+}
+
+/*
+ * Applies and discards the edits of the batch.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool manager_flush_batch(ManagerObject* self,
+                                libtocc_python::EditBatch& batch)
+{
+  if (batch.is_empty())
+  {
+    return true;
+  }
+
+  bool succeed = true;
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    manager_locked_apply_batch(self, batch);
+  }
+  catch (libtocc::BaseException& error)
+  {
+    libtocc_python::set_libtocc_error(error);
+    succeed = false;
+  }
+
+  // Some of the edits may be applied even if it failed.
+  std::vector<const char*> file_ids;
+  batch.get_file_ids(file_ids);
+  manager_invalidate_files(self, &file_ids[0], (int)file_ids.size());
+  batch.clear();
+
+  return succeed;
+}
+
+/*
+ * Sets an OSError for the error.
+ */
+static void set_file_transfer_error(libtocc_python::FileTransferError& error)
+{
+  errno = error.get_error_number();
+  PyErr_SetFromErrnoWithFilename(PyExc_OSError, error.get_path().c_str());
+}
+
+/*
+ * Converts the `import_mode' argument of the import methods.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_import_mode(PyObject* import_mode,
+                                  libtocc_python::ImportMode* out_import_mode)
+{
+  *out_import_mode = libtocc_python::IMPORT_MODE_COPY;
+  if (import_mode == NULL || import_mode == Py_None)
+  {
+    return true;
+  }
+
+  const char* import_mode_str = libtocc_python::python_unicode_to_char(import_mode);
+  if (import_mode_str == NULL)
+  {
+    return false;
+  }
+  if (strcmp(import_mode_str, "copy") == 0)
+  {
+    *out_import_mode = libtocc_python::IMPORT_MODE_COPY;
+  }
+  else if (strcmp(import_mode_str, "hardlink") == 0)
+  {
+    *out_import_mode = libtocc_python::IMPORT_MODE_HARDLINK;
+  }
+  else if (strcmp(import_mode_str, "reflink") == 0)
+  {
+    *out_import_mode = libtocc_python::IMPORT_MODE_REFLINK;
+  }
+  else if (strcmp(import_mode_str, "copy_file_range") == 0)
+  {
+    *out_import_mode = libtocc_python::IMPORT_MODE_COPY_FILE_RANGE;
+  }
+  else if (strcmp(import_mode_str, "move") == 0)
+  {
+    *out_import_mode = libtocc_python::IMPORT_MODE_MOVE;
+  }
+  else
+  {
+    PyErr_Format(PyExc_ValueError,
+                 "import_mode should be \"copy\", \"hardlink\", \"reflink\", "
+                 "\"copy_file_range\" or \"move\". Found: %s",
+                 import_mode_str);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Converts the `import_mode' and `dedup' arguments of the import methods.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_import_options(PyObject* import_mode, PyObject* dedup,
+                                     ImportOptions* out_options)
+{
+  if (!python_to_import_mode(import_mode, &out_options->import_mode))
+  {
+    return false;
+  }
+
+  out_options->dedup = false;
+  if (dedup != NULL)
+  {
+    int dedup_value = PyObject_IsTrue(dedup);
+    if (dedup_value < 0)
+    {
+      return false;
+    }
+    out_options->dedup = dedup_value;
+  }
+
+  return true;
+}
+
+static PyObject* manager_initialize(ManagerObject* self)
+{
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    self->manager_instance->initialize();
+  }
+  catch (libtocc::BaseException& error)
+  {
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/*
+ * Parameters of get_file_info.
+ */
+static const char* get_file_info_kwlist[] = { "file_id", NULL };
+
+static PyObject* manager_get_file_info(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                       PyObject* kwnames)
+{
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("get_file_info", args, nargs, kwnames,
+                                            get_file_info_kwlist, 1, values))
+  {
+    return NULL;
+  }
+  const char* file_id = libtocc_python::python_unicode_to_char(values[0]);
+  if (file_id == NULL)
+  {
+    return NULL;
+  }
+
+  unsigned long cache_generation = 0;
+  if (self->file_info_cache != NULL)
+  {
+    PyObject* cached = self->file_info_cache->get_by_id(file_id);
+    if (cached != NULL)
+    {
+      return cached;
+    }
+    cache_generation = self->file_info_cache->get_generation();
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    libtocc::FileInfo result = self->manager_instance->get_file_info(file_id);
+    gil_releaser.restore();
+
+    PyObject* python_result = create_python_file_info(result);
+    if (python_result != NULL && self->file_info_cache != NULL)
+    {
+      self->file_info_cache->insert(cache_generation, result, python_result);
+    }
+    return python_result;
+  }
+  catch (libtocc::BaseException& error)
+  {
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+}
+
+/*
+ * What get_file_infos does with the files that are not found.
+ */
+enum MissingFilesAction
+{
+  MISSING_FILES_RAISE,
+  MISSING_FILES_SKIP,
+  MISSING_FILES_NONE
+};
+
+/*
+ * Converts the `missing' argument of get_file_infos.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_missing_files_action(PyObject* missing,
+                                           MissingFilesAction* out_action)
+{
+  *out_action = MISSING_FILES_RAISE;
+  if (missing == NULL)
+  {
+    return true;
+  }
+  if (missing == Py_None)
+  {
+    *out_action = MISSING_FILES_NONE;
+    return true;
+  }
+
+  const char* missing_str = libtocc_python::python_unicode_to_char(missing);
+  if (missing_str == NULL)
+  {
+    return false;
+  }
+  if (strcmp(missing_str, "raise") == 0)
+  {
+    *out_action = MISSING_FILES_RAISE;
+  }
+  else if (strcmp(missing_str, "skip") == 0)
+  {
+    *out_action = MISSING_FILES_SKIP;
+  }
+  else if (strcmp(missing_str, "none") == 0)
+  {
+    *out_action = MISSING_FILES_NONE;
+  }
+  else
+  {
+    PyErr_Format(PyExc_ValueError,
+                 "missing should be \"raise\", \"skip\", \"none\" or None. Found: %s",
+                 missing_str);
+    return false;
+  }
+
+  return true;
+}
+
+static PyObject* manager_get_file_infos(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                        PyObject* kwnames)
+{
+  static const char* kwlist[] = { "file_ids", "missing", NULL };
+  PyObject* values[2];
+
+  if (!libtocc_python::unpack_fastcall_args("get_file_infos", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+  MissingFilesAction missing_action;
+  if (!python_to_missing_files_action(values[1], &missing_action))
+  {
+    return NULL;
+  }
+
+  // Keeps the IDs until the libtocc calls return.
+  libtocc_python::StringArena arena;
+  const char** file_ids_array;
+  int file_ids_size;
+  if (!create_file_ids_array(values[0], arena, &file_ids_array, &file_ids_size))
+  {
+    return NULL;
+  }
+
+  // Files of each position of the result. New references.
+  std::vector<PyObject*> file_info_objects(file_ids_size, (PyObject*)NULL);
+  // Positions that are not in the cache.
+  std::vector<int> fetch_positions;
+  fetch_positions.reserve(file_ids_size);
+
+  unsigned long cache_generation = 0;
+  if (self->file_info_cache != NULL)
+  {
+    cache_generation = self->file_info_cache->get_generation();
+    for (int i = 0; i < file_ids_size; i++)
+    {
+      file_info_objects[i] = self->file_info_cache->get_by_id(file_ids_array[i]);
+      if (file_info_objects[i] == NULL)
+      {
+        fetch_positions.push_back(i);
+      }
+    }
+  }
+  else
+  {
+    for (int i = 0; i < file_ids_size; i++)
+    {
+      fetch_positions.push_back(i);
+    }
+  }
+
+  // Found files, and their positions.
+  std::vector<libtocc::FileInfo> fetched;
+  std::vector<int> fetched_positions;
+  fetched.reserve(fetch_positions.size());
+  fetched_positions.reserve(fetch_positions.size());
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+
+    for (size_t i = 0; i < fetch_positions.size(); i++)
+    {
+      const char* file_id = file_ids_array[fetch_positions[i]];
+      if (missing_action == MISSING_FILES_RAISE)
+      {
+        fetched.push_back(self->manager_instance->get_file_info(file_id));
+      }
+      else
+      {
+        try
+        {
+          fetched.push_back(self->manager_instance->get_file_info(file_id));
+        }
+        catch (libtocc::DatabaseScriptLogicalError&)
+        {
+          // A missing file. Other errors (e.g. of the database itself)
+          // are raised, as they are with "raise".
+          continue;
+        }
+      }
+      fetched_positions.push_back(fetch_positions[i]);
+    }
+  }
+  catch (libtocc::BaseException& error)
+  {
+    for (int i = 0; i < file_ids_size; i++)
+    {
+      Py_XDECREF(file_info_objects[i]);
+    }
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  bool failed = false;
+  for (size_t i = 0; i < fetched.size(); i++)
+  {
+    PyObject* file_info_object = create_python_file_info(fetched[i]);
+    if (file_info_object == NULL)
+    {
+      failed = true;
+      break;
+    }
+    if (self->file_info_cache != NULL)
+    {
+      self->file_info_cache->insert(cache_generation, fetched[i], file_info_object);
+    }
+    file_info_objects[fetched_positions[i]] = file_info_object;
+  }
+
+  Py_ssize_t result_size = file_ids_size;
+  if (missing_action == MISSING_FILES_SKIP)
+  {
+    result_size = 0;
+    for (int i = 0; i < file_ids_size; i++)
+    {
+      if (file_info_objects[i] != NULL)
+      {
+        result_size++;
+      }
+    }
+  }
+
+  PyObject* result = NULL;
+  if (!failed)
+  {
+    result = PyList_New(result_size);
+  }
+  if (result == NULL)
+  {
+    for (int i = 0; i < file_ids_size; i++)
+    {
+      Py_XDECREF(file_info_objects[i]);
+    }
+    return NULL;
+  }
+
+  // List steals the references.
+  Py_ssize_t result_position = 0;
+  for (int i = 0; i < file_ids_size; i++)
+  {
+    if (file_info_objects[i] != NULL)
+    {
+      PyList_SET_ITEM(result, result_position++, file_info_objects[i]);
+    }
+    else if (missing_action == MISSING_FILES_NONE)
+    {
+      Py_INCREF(Py_None);
+      PyList_SET_ITEM(result, result_position++, Py_None);
+    }
+  }
+
+  return result;
+}
+
+static PyObject* manager_get_file_by_traditional_path(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                                      PyObject* kwnames)
+{
+  static const char* kwlist[] = { "traditional_path", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("get_file_by_traditional_path", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+  const char* traditional_path = libtocc_python::python_unicode_to_char(values[0]);
+  if (traditional_path == NULL)
+  {
+    return NULL;
+  }
+
+  unsigned long cache_generation = 0;
+  if (self->file_info_cache != NULL)
+  {
+    PyObject* cached =
+        self->file_info_cache->get_by_traditional_path(traditional_path);
+    if (cached != NULL)
+    {
+      return cached;
+    }
+    cache_generation = self->file_info_cache->get_generation();
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    libtocc::FileInfo result =
+        self->manager_instance->get_file_by_traditional_path(traditional_path);
+    gil_releaser.restore();
+
+    PyObject* python_result = create_python_file_info(result);
+    if (python_result != NULL && self->file_info_cache != NULL)
+    {
+      self->file_info_cache->insert(cache_generation, result, python_result);
+    }
+    return python_result;
+  }
+  catch (libtocc::BaseException& error)
+  {
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+}
+
+/*
+ * Parameters of import_file.
+ */
+static const char* import_file_kwlist[] = { "source_path", "title",
+                                            "traditional_path", "tags",
+                                            "import_mode", "dedup", NULL };
+
+/*
+ * Converts the unpacked title, traditional_path and tags arguments of
+ * the import methods.
+ * Strings are borrowed from the arguments.
+ *
+ * @param out_tags: Will be NULL if there's no tags. Otherwise the caller
+ *   should delete it.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_import_metadata(PyObject** values,
+                                      const char** out_title,
+                                      const char** out_traditional_path,
+                                      libtocc::TagsCollection** out_tags)
+{
+  *out_title = "";
+  if (values[0] != NULL)
+  {
+    *out_title = libtocc_python::python_unicode_to_char(values[0]);
+    if (*out_title == NULL)
+    {
+      return false;
+    }
+  }
+  *out_traditional_path = "";
+  if (values[1] != NULL)
+  {
+    *out_traditional_path = libtocc_python::python_unicode_to_char(values[1]);
+    if (*out_traditional_path == NULL)
+    {
+      return false;
+    }
+  }
+
+  *out_tags = NULL;
+  PyObject* tags_list = values[2];
+  if (tags_list != NULL && tags_list != Py_None)
+  {
+    // Creating a tags collection from the list of tags.
+    *out_tags = libtocc_python::tags_list_to_collection(tags_list);
+    if (*out_tags == NULL)
+    {
+      return false;
+    }
+    if ((*out_tags)->size() == 0)
+    {
+      delete *out_tags;
+      *out_tags = NULL;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Converts the unpacked arguments of import_file.
+ * Strings are borrowed from the arguments.
+ *
+ * @param out_tags: Will be NULL if there's no tags. Otherwise the caller
+ *   should delete it.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_import_file_args(PyObject** values,
+                                       const char** out_source_path,
+                                       const char** out_title,
+                                       const char** out_traditional_path,
+                                       libtocc::TagsCollection** out_tags,
+                                       ImportOptions* out_options)
+{
+  *out_source_path = libtocc_python::python_unicode_to_char(values[0]);
+  if (*out_source_path == NULL)
+  {
+    return false;
+  }
+  if (!python_to_import_options(values[4], values[5], out_options))
+  {
+    return false;
+  }
+
+  return python_to_import_metadata(&values[1], out_title, out_traditional_path,
+                                   out_tags);
+}
+
+static PyObject* manager_import_file(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                     PyObject* kwnames)
+{
+  PyObject* values[6];
+
+  if (!libtocc_python::unpack_fastcall_args("import_file", args, nargs, kwnames,
+                                            import_file_kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  const char* source_path;
+  const char* title;
+  const char* traditional_path;
+  libtocc::TagsCollection* tags_collection;
+  ImportOptions options;
+  if (!python_to_import_file_args(values, &source_path, &title,
+                                  &traditional_path, &tags_collection,
+                                  &options))
+  {
+    return NULL;
+  }
+
+  try
+  {
+    // The import takes the lock itself, only for the libtocc calls.
+    libtocc_python::GILReleaser gil_releaser(NULL);
+    libtocc::FileInfo result =
+        manager_unlocked_import_file(self, source_path, title,
+                                     traditional_path, tags_collection,
+                                     options);
+    gil_releaser.restore();
+
+    delete tags_collection;
+    manager_invalidate_traditional_path(self, traditional_path);
+    if (options.dedup)
+    {
+      // Tags of an existing file may be changed.
+      const char* file_id = result.get_id();
+      manager_invalidate_files(self, &file_id, 1);
+    }
+
+    return create_python_file_info(result);
+  }
+  catch (libtocc::BaseException& error)
+  {
+    delete tags_collection;
+    manager_invalidate_traditional_path(self, traditional_path);
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+  catch (libtocc_python::FileTransferError& error)
+  {
+    delete tags_collection;
+    manager_invalidate_traditional_path(self, traditional_path);
+    set_file_transfer_error(error);
+    return NULL;
+  }
+}
+
+/*
+ * Imports the contents that the writer writes. Shared by import_bytes
+ * and import_fd.
+ *
+ * @param metadata: Unpacked title, traditional_path and tags arguments.
+ */
+static PyObject* manager_import_content(ManagerObject* self, PyObject** metadata,
+                                        ContentWriter& writer)
+{
+  const char* title;
+  const char* traditional_path;
+  libtocc::TagsCollection* tags_collection;
+  if (!python_to_import_metadata(metadata, &title, &traditional_path,
+                                 &tags_collection))
+  {
+    return NULL;
+  }
+
+  try
+  {
+    // Contents are written without the lock. It's taken only for the
+    // libtocc calls.
+    libtocc_python::GILReleaser gil_releaser(NULL);
+    libtocc::FileInfo result =
+        manager_unlocked_store_content(self, title, traditional_path,
+                                       tags_collection, writer);
+    gil_releaser.restore();
+
+    delete tags_collection;
+    manager_invalidate_traditional_path(self, traditional_path);
+
+    return create_python_file_info(result);
+  }
+  catch (libtocc::BaseException& error)
+  {
+    delete tags_collection;
+    manager_invalidate_traditional_path(self, traditional_path);
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+  catch (libtocc_python::FileTransferError& error)
+  {
+    delete tags_collection;
+    manager_invalidate_traditional_path(self, traditional_path);
+    set_file_transfer_error(error);
+    return NULL;
+  }
+}
+
+static PyObject* manager_import_bytes(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                      PyObject* kwnames)
+{
+  static const char* kwlist[] = { "data", "title", "traditional_path", "tags",
+                                  NULL };
+  PyObject* values[4];
+
+  if (!libtocc_python::unpack_fastcall_args("import_bytes", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  // While the buffer is exported, its memory can't be freed or resized,
+  // so it can be read without the GIL.
+  Py_buffer buffer;
+  if (PyObject_GetBuffer(values[0], &buffer, PyBUF_SIMPLE) < 0)
+  {
+    return NULL;
+  }
+
+  BufferWriter writer((const char*)buffer.buf, buffer.len);
+  PyObject* result = manager_import_content(self, &values[1], writer);
+
+  PyBuffer_Release(&buffer);
+  return result;
+}
+
+static PyObject* manager_import_fd(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                   PyObject* kwnames)
+{
+  static const char* kwlist[] = { "fd", "title", "traditional_path", "tags",
+                                  NULL };
+  PyObject* values[4];
+
+  if (!libtocc_python::unpack_fastcall_args("import_fd", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  int fd = PyObject_AsFileDescriptor(values[0]);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  DescriptorWriter writer(fd);
+  return manager_import_content(self, &values[1], writer);
+}
+
+/*
+ * Arguments of a single import in a bulk import, converted from Python
+ * objects, so they can be used while the GIL is released.
+ */
+struct ImportRecord
+{
+  std::string source_path;
+  std::string title;
+  std::string traditional_path;
+  libtocc::TagsCollection* tags;
+  ImportOptions options;
+};
+
+/*
+ * Converts one record of import_files to an ImportRecord.
+ * Record can be a tuple (or list) of
+ * (source_path[, title[, traditional_path[, tags]]]), or a dict with the
+ * same keys.
+ *
+ * @return: false if the record is invalid. Sets the Python error.
+ */
+static bool python_to_import_record(PyObject* item, ImportRecord& record)
+{
+  static const char* kwlist[] = { "source_path", "title", "traditional_path",
+                                  "tags", NULL };
+  // Borrowed references. Missing ones are NULL.
+  PyObject* values[4] = { NULL, NULL, NULL, NULL };
+  // Keeps the tuple that `values' are borrowed from, if one is created.
+  PyObject* record_tuple = NULL;
+
+  if (PyDict_Check(item))
+  {
+    for (int i = 0; kwlist[i] != NULL; i++)
+    {
+      values[i] = PyDict_GetItemString(item, kwlist[i]);
+    }
+    if (values[0] == NULL)
+    {
+      PyErr_SetString(PyExc_KeyError, "Import record has no `source_path'.");
+      return false;
+    }
+  }
+  else if (PyTuple_Check(item) || PyList_Check(item))
+  {
+    record_tuple = PySequence_Tuple(item);
+    if (record_tuple == NULL)
+    {
+      return false;
+    }
+    if (!libtocc_python::unpack_tuple_args("import_files", record_tuple, NULL,
+                                           kwlist, 1, values))
+    {
+      Py_DECREF(record_tuple);
+      return false;
+    }
+  }
+  else
+  {
+    PyErr_Format(PyExc_TypeError,
+                 "Import record should be a tuple or a dict. Found: %s",
+                 Py_TYPE(item)->tp_name);
+    return false;
+  }
+  libtocc_python::PyObjectHolder record_tuple_holder(record_tuple);
+
+  const char* source_path = libtocc_python::python_unicode_to_char(values[0]);
+  if (source_path == NULL)
+  {
+    return false;
+  }
+  const char* title = "";
+  if (values[1] != NULL && values[1] != Py_None)
+  {
+    title = libtocc_python::python_unicode_to_char(values[1]);
+    if (title == NULL)
+    {
+      return false;
+    }
+  }
+  const char* traditional_path = "";
+  if (values[2] != NULL && values[2] != Py_None)
+  {
+    traditional_path = libtocc_python::python_unicode_to_char(values[2]);
+    if (traditional_path == NULL)
+    {
+      return false;
+    }
+  }
+  PyObject* tags_list = values[3];
+
+  record.source_path = source_path;
+  record.title = title;
+  record.traditional_path = traditional_path;
+  record.tags = NULL;
+  if (tags_list != NULL && tags_list != Py_None)
+  {
+    record.tags = libtocc_python::tags_list_to_collection(tags_list);
+    if (record.tags == NULL)
+    {
+      return false;
+    }
+    if (record.tags->size() == 0)
+    {
+      delete record.tags;
+      record.tags = NULL;
+    }
+  }
+
+  return true;
+}
+
+static PyObject* manager_import_files(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                      PyObject* kwnames)
+{
+  static const char* kwlist[] = { "records", "ids_only", "import_mode", "dedup",
+                                  NULL };
+  PyObject* values[4];
+
+  if (!libtocc_python::unpack_fastcall_args("import_files", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  PyObject* records = values[0];
+  int ids_only = 0;
+  if (values[1] != NULL)
+  {
+    ids_only = PyObject_IsTrue(values[1]);
+    if (ids_only < 0)
+    {
+      return NULL;
+    }
+  }
+  ImportOptions options;
+  if (!python_to_import_options(values[2], values[3], &options))
+  {
+    return NULL;
+  }
+
+  PyObject* records_iterator = PyObject_GetIter(records);
+  if (records_iterator == NULL)
+  {
+    return NULL;
+  }
+  libtocc_python::PyObjectHolder records_iterator_holder(records_iterator);
+
+  // Converting all of the records, before releasing the GIL.
+  std::vector<ImportRecord> import_records;
+  PyObject* item;
+  while ((item = PyIter_Next(records_iterator)) != NULL)
+  {
+    libtocc_python::PyObjectHolder item_holder(item);
+
+    ImportRecord record;
+    if (!python_to_import_record(item, record))
+    {
+      for (size_t i = 0; i < import_records.size(); i++)
+      {
+        delete import_records[i].tags;
+      }
+      return NULL;
+    }
+    record.options = options;
+    import_records.push_back(record);
+  }
+  if (PyErr_Occurred())
+  {
+    for (size_t i = 0; i < import_records.size(); i++)
+    {
+      delete import_records[i].tags;
+    }
+    return NULL;
+  }
+
+  // Importing the whole batch. Failure of one file doesn't stop the others.
+  libtocc::FileInfoCollection imported_files(import_records.size());
+  std::vector<std::pair<size_t, std::string> > failures;
+  {
+    // Each import takes the lock itself, only for the libtocc calls.
+    libtocc_python::GILReleaser gil_releaser(NULL);
+
+    for (size_t i = 0; i < import_records.size(); i++)
+    {
+      try
+      {
+        libtocc::FileInfo result =
+            manager_unlocked_import_file(self,
+                                         import_records[i].source_path.c_str(),
+                                         import_records[i].title.c_str(),
+                                         import_records[i].traditional_path.c_str(),
+                                         import_records[i].tags,
+                                         import_records[i].options);
+        imported_files.add_file_info(result);
+      }
+      catch (libtocc::BaseException& error)
+      {
+        failures.push_back(std::make_pair(i, std::string(error.what())));
+      }
+      catch (libtocc_python::FileTransferError& error)
+      {
+        failures.push_back(std::make_pair(i, std::string(error.what())));
+      }
+
+      delete import_records[i].tags;
+      import_records[i].tags = NULL;
+    }
+  }
+
+  for (size_t i = 0; i < import_records.size(); i++)
+  {
+    manager_invalidate_traditional_path(
+        self, import_records[i].traditional_path.c_str());
+  }
+  if (options.dedup)
+  {
+    // Tags of existing files may be changed.
+    manager_invalidate_files(self, imported_files);
+  }
+
+  // Creating the result.
+  PyObject* imported_list;
+  if (ids_only)
+  {
+    imported_list = PyList_New(imported_files.size());
+    if (imported_list == NULL)
+    {
+      return NULL;
+    }
+
+    int list_index = 0;
+    libtocc::FileInfoCollection::Iterator iterator(&imported_files);
+    for (; !iterator.is_finished(); iterator.next())
+    {
+      PyList_SET_ITEM(imported_list, list_index,
+                      PyUnicode_FromString(iterator.get()->get_id()));
+      list_index++;
+    }
+  }
+  else
+  {
+    imported_list = create_python_file_info_list(imported_files);
+    if (imported_list == NULL)
+    {
+      return NULL;
+    }
+  }
+  libtocc_python::PyObjectHolder imported_list_holder(imported_list);
+
+  PyObject* failures_list = PyList_New(failures.size());
+  if (failures_list == NULL)
+  {
+    return NULL;
+  }
+  libtocc_python::PyObjectHolder failures_list_holder(failures_list);
+
+  for (size_t i = 0; i < failures.size(); i++)
+  {
+    PyObject* failure = Py_BuildValue(
+        "(nss)",
+        (Py_ssize_t)failures[i].first,
+        import_records[failures[i].first].source_path.c_str(),
+        failures[i].second.c_str());
+    if (failure == NULL)
+    {
+      return NULL;
+    }
+    PyList_SET_ITEM(failures_list, i, failure);
+  }
+
+  return PyTuple_Pack(2, imported_list, failures_list);
+}
+
+/*
+ * Where import_directory takes the traditional paths of the files from.
+ */
+enum TraditionalPathSource
+{
+  TRADITIONAL_PATH_NONE,
+  TRADITIONAL_PATH_ABSOLUTE,
+  TRADITIONAL_PATH_RELATIVE
+};
+
+/*
+ * Number of the files import_directory imports between progress calls.
+ * The GIL is re-acquired for each chunk.
+ */
+static const int IMPORT_DIRECTORY_CHUNK_SIZE = 64;
+
+/*
+ * Converts the `traditional_path_from' argument of import_directory.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_traditional_path_source(PyObject* source,
+                                              TraditionalPathSource* out_source)
+{
+  *out_source = TRADITIONAL_PATH_NONE;
+  if (source == NULL || source == Py_None)
+  {
+    return true;
+  }
+
+  const char* source_str = libtocc_python::python_unicode_to_char(source);
+  if (source_str == NULL)
+  {
+    return false;
+  }
+  if (strcmp(source_str, "absolute") == 0)
+  {
+    *out_source = TRADITIONAL_PATH_ABSOLUTE;
+  }
+  else if (strcmp(source_str, "relative") == 0)
+  {
+    *out_source = TRADITIONAL_PATH_RELATIVE;
+  }
+  else
+  {
+    PyErr_Format(PyExc_ValueError,
+                 "traditional_path_from should be None, \"absolute\" or \"relative\". Found: %s",
+                 source_str);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Adds names of the directories of the relative path as tags.
+ */
+static void add_path_tags(libtocc::TagsCollection& tags,
+                          const std::string& relative_path)
+{
+  size_t start = 0;
+  size_t separator;
+  while ((separator = relative_path.find('/', start)) != std::string::npos)
+  {
+    if (separator > start)
+    {
+      tags.add_tag(relative_path.substr(start, separator - start).c_str());
+    }
+    start = separator + 1;
+  }
+}
+
+/*
+ * Creates the dict that import_directory returns.
+ *
+ * @param failures: Files that couldn't be imported. Errors of the walker
+ *   are added after them.
+ */
+static PyObject* create_import_directory_report(
+    const std::vector<std::string>& imported_ids,
+    const std::vector<std::pair<std::string, std::string> >& failures,
+    libtocc_python::DirectoryWalker& walker)
+{
+  PyObject* imported_list = PyList_New(imported_ids.size());
+  if (imported_list == NULL)
+  {
+    return NULL;
+  }
+  libtocc_python::PyObjectHolder imported_list_holder(imported_list);
+  for (size_t i = 0; i < imported_ids.size(); i++)
+  {
+    PyObject* file_id = PyUnicode_FromString(imported_ids[i].c_str());
+    if (file_id == NULL)
+    {
+      return NULL;
+    }
+    PyList_SET_ITEM(imported_list, i, file_id);
+  }
+
+  // Directories that couldn't be read come after the files.
+  const std::vector<std::pair<std::string, std::string> >& walker_errors =
+      walker.get_errors();
+  PyObject* failures_list = PyList_New(failures.size() + walker_errors.size());
+  if (failures_list == NULL)
+  {
+    return NULL;
+  }
+  libtocc_python::PyObjectHolder failures_list_holder(failures_list);
+  for (size_t i = 0; i < failures.size() + walker_errors.size(); i++)
+  {
+    const std::pair<std::string, std::string>& item =
+        i < failures.size() ? failures[i] : walker_errors[i - failures.size()];
+    PyObject* failure = Py_BuildValue("(ss)", item.first.c_str(),
+                                      item.second.c_str());
+    if (failure == NULL)
+    {
+      return NULL;
+    }
+    PyList_SET_ITEM(failures_list, i, failure);
+  }
+
+  return Py_BuildValue("{sOsOsk}",
+                       "imported", imported_list,
+                       "failures", failures_list,
+                       "skipped", walker.get_skipped());
+}
+
+/*
+ * Sets the report of what's done so far as the `report' attribute of
+ * the exception that stopped import_directory. The exception is kept
+ * as it is if the report can't be attached.
+ */
+static void attach_import_directory_report(
+    const std::vector<std::string>& imported_ids,
+    const std::vector<std::pair<std::string, std::string> >& failures,
+    libtocc_python::DirectoryWalker& walker)
+{
+  PyObject* type;
+  PyObject* value;
+  PyObject* traceback;
+  PyErr_Fetch(&type, &value, &traceback);
+  PyErr_NormalizeException(&type, &value, &traceback);
+
+  PyObject* report = create_import_directory_report(imported_ids, failures,
+                                                    walker);
+  if (report == NULL || value == NULL ||
+      PyObject_SetAttrString(value, "report", report) < 0)
+  {
+    PyErr_Clear();
+  }
+  Py_XDECREF(report);
+
+  PyErr_Restore(type, value, traceback);
+}
+
+/*
+ * A file that import_directory found.
+ */
+struct DirectoryImportEntry
+{
+  std::string relative_path;
+  std::string full_path;
+  // Following are set by `manager_unlocked_prepare_entry'.
+  // Contents of the file, if it's not a duplicate.
+  std::unique_ptr<libtocc_python::StagedFile> staged_file;
+  libtocc_python::ContentHash content_hash;
+  // Imported file with the same contents, with dedup.
+  std::string duplicate_id;
+  bool failed;
+  std::string error;
+};
+
+/*
+ * Transfers contents of the entry to a staged file, or finds its
+ * duplicate. Import mode shouldn't be `copy'. Called without the lock,
+ * on one of the import_directory's workers, so it never throws: errors
+ * are kept in the entry.
+ */
+static void manager_unlocked_prepare_entry(ManagerObject* self,
+                                           DirectoryImportEntry& entry,
+                                           const ImportOptions& options)
+{
+  entry.failed = false;
+  try
+  {
+    if (options.dedup)
+    {
+      entry.content_hash = libtocc_python::hash_file(entry.full_path.c_str());
+      if (manager_unlocked_find_duplicate(self, entry.full_path.c_str(),
+                                          entry.content_hash,
+                                          entry.duplicate_id))
+      {
+        return;
+      }
+    }
+    entry.staged_file.reset(
+        manager_unlocked_stage_file(self, entry.full_path.c_str(),
+                                    options.import_mode));
+  }
+  catch (libtocc::BaseException& error)
+  {
+    entry.failed = true;
+    entry.error = error.what();
+  }
+  catch (std::exception& error)
+  {
+    entry.failed = true;
+    entry.error = error.what();
+  }
+}
+
+/*
+ * Shared state of the threads that prepare a chunk of import_directory.
+ */
+struct PrepareEntriesJob
+{
+  ManagerObject* manager;
+  std::vector<DirectoryImportEntry>* entries;
+  const ImportOptions* options;
+  // Index of the next entry that no thread took yet.
+  std::atomic<size_t> next_entry;
+};
+
+static void prepare_entries_work(PrepareEntriesJob* job)
+{
+  while (true)
+  {
+    size_t index = job->next_entry++;
+    if (index >= job->entries->size())
+    {
+      return;
+    }
+    manager_unlocked_prepare_entry(job->manager, (*job->entries)[index],
+                                   *job->options);
+  }
+}
+
+/*
+ * Prepares the entries on `workers' threads, or on the calling thread if
+ * it's zero. Returns when all of them are prepared.
+ */
+static void manager_unlocked_prepare_entries(ManagerObject* self,
+                                             std::vector<DirectoryImportEntry>& entries,
+                                             const ImportOptions& options,
+                                             size_t workers)
+{
+  PrepareEntriesJob job;
+  job.manager = self;
+  job.entries = &entries;
+  job.options = &options;
+  job.next_entry = 0;
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < std::min(workers, entries.size()); i++)
+  {
+    threads.push_back(std::thread(prepare_entries_work, &job));
+  }
+  // The calling thread helps as well, and does all of it if there's no
+  // workers.
+  prepare_entries_work(&job);
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i].join();
+  }
+}
+
+/*
+ * Imports a prepared entry. Mostly only the libtocc calls are done here,
+ * with the lock held. But if the duplicate of the file is removed since
+ * it's found, the file is staged now.
+ */
+static libtocc::FileInfo manager_unlocked_import_prepared_entry(ManagerObject* self,
+                                                                DirectoryImportEntry& entry,
+                                                                const char* traditional_path,
+                                                                libtocc::TagsCollection* tags,
+                                                                const ImportOptions& options)
+{
+  if (options.dedup && entry.duplicate_id.empty())
+  {
+    // Files of a chunk are prepared together, so one of them may be the
+    // duplicate of another one that's just imported.
+    manager_unlocked_find_duplicate(self, entry.full_path.c_str(),
+                                    entry.content_hash, entry.duplicate_id);
+  }
+  if (!entry.duplicate_id.empty())
+  {
+    libtocc_python::LockHolder lock_holder(self->lock);
+    if (manager_locked_reuse_duplicate(self, entry.content_hash,
+                                       entry.duplicate_id, tags))
+    {
+      if (options.import_mode == libtocc_python::IMPORT_MODE_MOVE)
+      {
+        // Its contents are stored already.
+        unlink(entry.full_path.c_str());
+      }
+      return self->manager_instance->get_file_info(entry.duplicate_id.c_str());
+    }
+  }
+  if (!entry.staged_file)
+  {
+    entry.staged_file.reset(
+        manager_unlocked_stage_file(self, entry.full_path.c_str(),
+                                    options.import_mode));
+  }
+
+  libtocc_python::LockHolder lock_holder(self->lock);
+  libtocc::FileInfo result =
+      manager_locked_commit_staged_file(self, *entry.staged_file, "",
+                                        traditional_path, tags);
+  if (options.dedup)
+  {
+    manager_locked_index_file(self, entry.content_hash, result.get_id());
+  }
+
+  if (options.import_mode == libtocc_python::IMPORT_MODE_MOVE)
+  {
+    // If it can't be removed, it's kept: the file is imported anyway.
+    unlink(entry.full_path.c_str());
+  }
+
+  return result;
+}
+
+static PyObject* manager_import_directory(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                          PyObject* kwnames)
+{
+  static const char* kwlist[] = { "root", "recursive", "tags", "tags_from_path",
+                                  "traditional_path_from", "workers", "progress",
+                                  "import_mode", "dedup", NULL };
+  PyObject* values[9];
+
+  if (!libtocc_python::unpack_fastcall_args("import_directory", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  const char* root = libtocc_python::python_unicode_to_char(values[0]);
+  if (root == NULL)
+  {
+    return NULL;
+  }
+  int recursive = 1;
+  if (values[1] != NULL && (recursive = PyObject_IsTrue(values[1])) < 0)
+  {
+    return NULL;
+  }
+  std::vector<std::string> common_tags;
+  if (values[2] != NULL && values[2] != Py_None)
+  {
+    libtocc::TagsCollection* tags = libtocc_python::tags_list_to_collection(values[2]);
+    if (tags == NULL)
+    {
+      return NULL;
+    }
+    libtocc::TagsCollection::Iterator iterator(tags);
+    for (; !iterator.is_finished(); iterator.next())
+    {
+      common_tags.push_back(iterator.get());
+    }
+    delete tags;
+  }
+  int tags_from_path = 0;
+  if (values[3] != NULL && (tags_from_path = PyObject_IsTrue(values[3])) < 0)
+  {
+    return NULL;
+  }
+  TraditionalPathSource traditional_path_source;
+  if (!python_to_traditional_path_source(values[4], &traditional_path_source))
+  {
+    return NULL;
+  }
+  Py_ssize_t workers = -1;
+  if (values[5] != NULL && values[5] != Py_None)
+  {
+    if (!libtocc_python::python_to_ssize_t(values[5], &workers))
+    {
+      return NULL;
+    }
+    if (workers < 0)
+    {
+      PyErr_SetString(PyExc_ValueError, "workers can't be negative.");
+      return NULL;
+    }
+  }
+  else
+  {
+    workers = std::thread::hardware_concurrency();
+    workers = std::max((Py_ssize_t)2, std::min(workers, (Py_ssize_t)8));
+  }
+  PyObject* progress = values[6];
+  if (progress == Py_None)
+  {
+    progress = NULL;
+  }
+  if (progress != NULL && !PyCallable_Check(progress))
+  {
+    PyErr_SetString(PyExc_TypeError, "progress should be callable.");
+    return NULL;
+  }
+  ImportOptions options;
+  if (!python_to_import_options(values[7], values[8], &options))
+  {
+    return NULL;
+  }
+
+  // Absolute traditional paths should be the same wherever the import
+  // runs from.
+  char absolute_root[PATH_MAX];
+  if (realpath(root, absolute_root) == NULL)
+  {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, root);
+    return NULL;
+  }
+  struct stat root_stat;
+  if (stat(absolute_root, &root_stat) != 0 || !S_ISDIR(root_stat.st_mode))
+  {
+    PyErr_Format(PyExc_NotADirectoryError, "Not a directory: %s", root);
+    return NULL;
+  }
+
+  libtocc_python::DirectoryWalker walker(absolute_root, recursive);
+  // With `copy', libtocc reads each file itself, under the lock, so the
+  // workers can only read the files ahead. Otherwise they transfer the
+  // files to staged files (see `manager_unlocked_prepare_entries').
+  bool prefetch = options.import_mode == libtocc_python::IMPORT_MODE_COPY;
+  libtocc_python::FilePrefetcher prefetcher(prefetch ? workers : 0);
+  // Files that are found, but not imported yet.
+  std::deque<std::string> pending;
+  // Files to find ahead of the one that's being imported.
+  size_t prefetch_window = prefetch ? workers * 4 : 0;
+  bool walked_all = false;
+
+  std::vector<std::string> imported_ids;
+  std::vector<std::pair<std::string, std::string> > failures;
+  std::vector<std::string> traditional_paths;
+
+  bool finished = false;
+  while (!finished)
+  {
+    size_t chunk_start = imported_ids.size();
+    std::vector<DirectoryImportEntry> chunk;
+    {
+      // Walking doesn't need the Manager, so it runs without its lock.
+      // Files of this chunk are found, plus a window ahead of its last
+      // one.
+      libtocc_python::GILReleaser gil_releaser(NULL);
+
+      while (!walked_all &&
+             pending.size() < IMPORT_DIRECTORY_CHUNK_SIZE + prefetch_window)
+      {
+        std::string relative_path;
+        if (!walker.next(relative_path))
+        {
+          walked_all = true;
+          break;
+        }
+        prefetcher.prefetch(walker.get_full_path(relative_path));
+        pending.push_back(std::string());
+        pending.back().swap(relative_path);
+      }
+
+      while (!pending.empty() && chunk.size() < IMPORT_DIRECTORY_CHUNK_SIZE)
+      {
+        chunk.push_back(DirectoryImportEntry());
+        DirectoryImportEntry& entry = chunk.back();
+        entry.relative_path.swap(pending.front());
+        pending.pop_front();
+        entry.full_path = walker.get_full_path(entry.relative_path);
+        entry.failed = false;
+      }
+      finished = pending.empty() && walked_all;
+    }
+    {
+      // Contents are transferred on the workers, without the lock. Then
+      // the files are imported one by one, each import taking the lock
+      // only for the libtocc calls.
+      libtocc_python::GILReleaser gil_releaser(NULL);
+
+      if (!prefetch)
+      {
+        manager_unlocked_prepare_entries(self, chunk, options, workers);
+      }
+
+      for (size_t i = 0; i < chunk.size(); i++)
+      {
+        DirectoryImportEntry& entry = chunk[i];
+        if (entry.failed)
+        {
+          failures.push_back(std::make_pair(entry.full_path, entry.error));
+          continue;
+        }
+
+        const char* traditional_path = "";
+        if (traditional_path_source == TRADITIONAL_PATH_ABSOLUTE)
+        {
+          traditional_path = entry.full_path.c_str();
+        }
+        else if (traditional_path_source == TRADITIONAL_PATH_RELATIVE)
+        {
+          traditional_path = entry.relative_path.c_str();
+        }
+
+        libtocc::TagsCollection tags(common_tags.size());
+        for (size_t j = 0; j < common_tags.size(); j++)
+        {
+          tags.add_tag(common_tags[j].c_str());
+        }
+        if (tags_from_path)
+        {
+          add_path_tags(tags, entry.relative_path);
+        }
+
+        try
+        {
+          // If there's no tags, collection is NULL, and libtocc won't
+          // assign any tags.
+          libtocc::TagsCollection* tags_collection = tags.size() > 0 ? &tags : NULL;
+          if (prefetch)
+          {
+            libtocc::FileInfo result =
+                manager_unlocked_import_file(self, entry.full_path.c_str(), "",
+                                             traditional_path, tags_collection,
+                                             options);
+            imported_ids.push_back(result.get_id());
+          }
+          else
+          {
+            libtocc::FileInfo result =
+                manager_unlocked_import_prepared_entry(self, entry,
+                                                       traditional_path,
+                                                       tags_collection, options);
+            imported_ids.push_back(result.get_id());
+          }
+        }
+        catch (libtocc::BaseException& error)
+        {
+          failures.push_back(std::make_pair(entry.full_path, std::string(error.what())));
+        }
+        catch (libtocc_python::FileTransferError& error)
+        {
+          failures.push_back(std::make_pair(entry.full_path, std::string(error.what())));
+        }
+        if (prefetch)
+        {
+          prefetcher.consumed();
+        }
+
+        if (traditional_path[0] != '\0')
+        {
+          traditional_paths.push_back(traditional_path);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < traditional_paths.size(); i++)
+    {
+      manager_invalidate_traditional_path(self, traditional_paths[i].c_str());
+    }
+    traditional_paths.clear();
+    if (options.dedup)
+    {
+      // Tags of existing files may be changed.
+      for (size_t i = chunk_start; i < imported_ids.size(); i++)
+      {
+        const char* file_id = imported_ids[i].c_str();
+        manager_invalidate_files(self, &file_id, 1);
+      }
+    }
+
+    if (progress != NULL)
+    {
+      PyObject* result = PyObject_CallFunction(progress, "nn",
+                                               (Py_ssize_t)imported_ids.size(),
+                                               (Py_ssize_t)failures.size());
+      if (result == NULL)
+      {
+        attach_import_directory_report(imported_ids, failures, walker);
+        return NULL;
+      }
+      Py_DECREF(result);
+    }
+    if (PyErr_CheckSignals() < 0)
+    {
+      attach_import_directory_report(imported_ids, failures, walker);
+      return NULL;
+    }
+  }
+
+  return create_import_directory_report(imported_ids, failures, walker);
+}
+
+static PyObject* manager_remove_file(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                     PyObject* kwnames)
+{
+  static const char* kwlist[] = { "file_id", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("remove_file", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+  const char* file_id = libtocc_python::python_unicode_to_char(values[0]);
+  if (file_id == NULL)
+  {
+    return NULL;
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    libtocc_python::TagsTableGuard tags_guard(self->tags_table);
+
+    libtocc::TagStatisticsCollection before;
+    if (tags_guard.get() != NULL)
+    {
+      before = self->manager_instance->get_tags_statistics(&file_id, 1);
+    }
+    self->manager_instance->remove_file(file_id);
+    if (tags_guard.get() != NULL)
+    {
+      tags_guard.get()->removed(before);
+    }
+    tags_guard.commit();
+  }
+  catch(libtocc::BaseException& error)
+  {
+    manager_invalidate_files(self, &file_id, 1);
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  manager_invalidate_files(self, &file_id, 1);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject* manager_remove_files(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                      PyObject* kwnames)
+{
+  static const char* kwlist[] = { "file_ids", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("remove_files", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  // Note that files_list is a borrowed reference,
+  // we do not touch its reference count.
+  PyObject* files_list = values[0];
+
+  libtocc::FileInfoCollection* file_infos =
+      libtocc_python::file_ids_to_info_collection(files_list);
+  if (file_infos == NULL)
+  {
+    return NULL;
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    libtocc_python::TagsTableGuard tags_guard(self->tags_table);
+
+    libtocc::TagStatisticsCollection before;
+    if (tags_guard.get() != NULL)
+    {
+      before = self->manager_instance->get_tags_statistics(*file_infos);
+    }
+    // Calling manager by the created collection.
+    self->manager_instance->remove_files(*file_infos);
+    if (tags_guard.get() != NULL)
+    {
+      tags_guard.get()->removed(before);
+    }
+    tags_guard.commit();
+  }
+  catch (libtocc::BaseException& error)
+  {
+    manager_invalidate_files(self, *file_infos);
+    delete file_infos;
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  manager_invalidate_files(self, *file_infos);
+  delete file_infos;
+
+  Py_RETURN_NONE;
+}
+
+/*
+ * Parameters of assign_tags.
+ */
+static const char* assign_tags_kwlist[] = { "file_ids", "tags", NULL };
+
+/*
+ * Converts the unpacked arguments of assign_tags (or unassign_tags).
+ * Caller should delete the collections.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_tags_change_args(PyObject** values,
+                                       libtocc::FileInfoCollection** out_file_infos,
+                                       libtocc::TagsCollection** out_tags)
+{
+  // Note that python objects are borrowed reference,
+  // we do not touch its reference count.
+  *out_file_infos = libtocc_python::file_ids_to_info_collection(values[0]);
+  if (*out_file_infos == NULL)
+  {
+    return false;
+  }
+  *out_tags = libtocc_python::tags_list_to_collection(values[1]);
+  if (*out_tags == NULL)
+  {
+    delete *out_file_infos;
+    return false;
+  }
+
+  return true;
+}
+
+static PyObject* manager_assign_tags(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                     PyObject* kwnames)
+{
+  PyObject* values[2];
+
+  if (!libtocc_python::unpack_fastcall_args("assign_tags", args, nargs, kwnames,
+                                            assign_tags_kwlist, 2, values))
+  {
+    return NULL;
+  }
+
+  libtocc::FileInfoCollection* file_infos;
+  libtocc::TagsCollection* tags;
+  if (!python_to_tags_change_args(values, &file_infos, &tags))
+  {
+    return NULL;
+  }
+
+  libtocc_python::EditBatch* batch = manager_get_batch(self);
+  if (batch != NULL)
+  {
+    batch_edit_tags(*batch, *file_infos, *tags, true);
+    delete file_infos;
+    delete tags;
+    Py_RETURN_NONE;
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    manager_locked_assign_tags(self, *file_infos, tags);
+  }
+  catch (libtocc::BaseException& error)
+  {
+    manager_invalidate_files(self, *file_infos);
+    delete file_infos;
+    delete tags;
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  manager_invalidate_files(self, *file_infos);
+  delete file_infos;
+  delete tags;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject* manager_unassign_tags(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                       PyObject* kwnames)
+{
+  PyObject* values[2];
+
+  if (!libtocc_python::unpack_fastcall_args("unassign_tags", args, nargs, kwnames,
+                                            assign_tags_kwlist, 2, values))
+  {
+    return NULL;
+  }
+
+  libtocc::FileInfoCollection* file_infos;
+  libtocc::TagsCollection* tags;
+  if (!python_to_tags_change_args(values, &file_infos, &tags))
+  {
+    return NULL;
+  }
+
+  libtocc_python::EditBatch* batch = manager_get_batch(self);
+  if (batch != NULL)
+  {
+    batch_edit_tags(*batch, *file_infos, *tags, false);
+    delete file_infos;
+    delete tags;
+    Py_RETURN_NONE;
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    manager_locked_unassign_tags(self, *file_infos, tags);
+  }
+  catch (libtocc::BaseException& error)
+  {
+    manager_invalidate_files(self, *file_infos);
+    delete file_infos;
+    delete tags;
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  manager_invalidate_files(self, *file_infos);
+  delete file_infos;
+  delete tags;
+
+  Py_RETURN_NONE;
+}
+
+/*
+ * Adds edits of each visited tag of a file to the batch.
+ */
+class BatchTagsVisitor : public libtocc_python::StringsVisitor
+{
+public:
+  BatchTagsVisitor(libtocc_python::EditBatch& batch, const char* file_id,
+                   bool assign)
+    : batch(batch)
+  {
+    this->file_id = file_id;
+    this->assign = assign;
+  }
+
+  virtual bool visit(const char* str, Py_ssize_t size)
+  {
+    this->batch.edit_tag(this->file_id, str, this->assign);
+    return true;
+  }
+
+private:
+  libtocc_python::EditBatch& batch;
+  const char* file_id;
+  bool assign;
+};
+
+/*
+ * Returns the mapping as a dict. If it's already a dict, it's returned
+ * itself.
+ *
+ * @return: New reference. NULL if any errors happen. It sets the Python
+ *   Error.
+ */
+static PyObject* python_mapping_to_dict(PyObject* mapping,
+                                        const char* type_error_message)
+{
+  if (PyDict_Check(mapping))
+  {
+    Py_INCREF(mapping);
+    return mapping;
+  }
+  // Sequences pass PyMapping_Check as well, but they can't be merged,
+  // since they don't have keys.
+  if (!PyMapping_Check(mapping) || !PyObject_HasAttrString(mapping, "keys"))
+  {
+    PyErr_SetString(PyExc_TypeError, type_error_message);
+    return NULL;
+  }
+
+  PyObject* dict = PyDict_New();
+  if (dict == NULL)
+  {
+    return NULL;
+  }
+  if (PyDict_Merge(dict, mapping, 1) < 0)
+  {
+    Py_DECREF(dict);
+    return NULL;
+  }
+  return dict;
+}
+
+/*
+ * Converts a {file_id: (tags_to_add, tags_to_remove)} mapping to edits
+ * of the batch.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_tag_changes(PyObject* changes,
+                                  libtocc_python::EditBatch& batch)
+{
+  PyObject* changes_dict = python_mapping_to_dict(
+      changes, "Expected a mapping of file IDs to (tags_to_add, tags_to_remove).");
+  if (changes_dict == NULL)
+  {
+    return false;
+  }
+  libtocc_python::PyObjectHolder changes_dict_holder(changes_dict);
+
+  Py_ssize_t position = 0;
+  PyObject* file_id;
+  PyObject* edit;
+  while (PyDict_Next(changes_dict, &position, &file_id, &edit))
+  {
+    const char* file_id_str = libtocc_python::python_unicode_to_char(file_id);
+    if (file_id_str == NULL)
+    {
+      return false;
+    }
+
+    if (!PyTuple_Check(edit) || PyTuple_GET_SIZE(edit) != 2)
+    {
+      PyErr_Format(PyExc_TypeError,
+                   "Changes of file %s should be a (tags_to_add, tags_to_remove) tuple.",
+                   file_id_str);
+      return false;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+      PyObject* tags = PyTuple_GET_ITEM(edit, i);
+      if (tags == Py_None)
+      {
+        continue;
+      }
+      // Tags to add are visited first, so a tag that is in both of them
+      // is unassigned.
+      BatchTagsVisitor visitor(batch, file_id_str, i == 0);
+      if (!libtocc_python::visit_strings(tags, visitor, 0))
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static PyObject* manager_apply_tag_changes(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                           PyObject* kwnames)
+{
+  static const char* kwlist[] = { "changes", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("apply_tag_changes", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  libtocc_python::EditBatch changes_batch;
+  if (!python_to_tag_changes(values[0], changes_batch))
+  {
+    return NULL;
+  }
+
+  libtocc_python::EditBatch* batch = manager_get_batch(self);
+  if (batch != NULL)
+  {
+    batch->merge(changes_batch);
+    Py_RETURN_NONE;
+  }
+
+  if (!manager_flush_batch(self, changes_batch))
+  {
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+static PyObject* manager_set_title(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                   PyObject* kwnames)
+{
+  static const char* kwlist[] = { "file_id", "title", NULL };
+  PyObject* values[2];
+
+  if (!libtocc_python::unpack_fastcall_args("set_title", args, nargs, kwnames,
+                                            kwlist, 2, values))
+  {
+    return NULL;
+  }
+
+  // Note that file_ids is a borrowed reference,
+  // we do not touch its reference count.
+  PyObject* file_ids = values[0];
+  const char* title = libtocc_python::python_unicode_to_char(values[1]);
+  if (title == NULL)
+  {
+    return NULL;
+  }
+
+  libtocc_python::EditBatch* batch = manager_get_batch(self);
+
+  if (PyUnicode_Check(file_ids))
+  {
+    const char* file_id_str = libtocc_python::python_unicode_to_char(file_ids);
+    if (file_id_str == NULL)
+    {
+      return NULL;
+    }
+
+    if (batch != NULL)
+    {
+      batch->set_title(file_id_str, title);
+      Py_RETURN_NONE;
+    }
+
+    try
+    {
+      libtocc_python::GILReleaser gil_releaser(self->lock);
+      self->manager_instance->set_title(file_id_str, title);
+    }
+    catch (libtocc::BaseException& error)
+    {
+      manager_invalidate_files(self, &file_id_str, 1);
+      libtocc_python::set_libtocc_error(error);
+      return NULL;
+    }
+
+    manager_invalidate_files(self, &file_id_str, 1);
+  }
+  else
+  {
+    // Keeps the IDs until the libtocc call returns.
+    libtocc_python::StringArena arena;
+    const char** file_ids_array;
+    int file_ids_size;
+    if (!create_file_ids_array(file_ids, arena, &file_ids_array, &file_ids_size))
+    {
+      return NULL;
+    }
+
+    if (batch != NULL)
+    {
+      for (int i = 0; i < file_ids_size; i++)
+      {
+        batch->set_title(file_ids_array[i], title);
+      }
+      Py_RETURN_NONE;
+    }
+
+    try
+    {
+      libtocc_python::GILReleaser gil_releaser(self->lock);
+      self->manager_instance->set_titles(file_ids_array, file_ids_size, title);
+    }
+    catch (libtocc::BaseException& error)
+    {
+      manager_invalidate_files(self, file_ids_array, file_ids_size);
+      libtocc_python::set_libtocc_error(error);
+      return NULL;
+    }
+
+    manager_invalidate_files(self, file_ids_array, file_ids_size);
+  }
+
+  Py_RETURN_NONE;
+}
+
+/*
+ * New title of a file: (title, file_id).
+ */
+typedef std::pair<const char*, const char*> TitleChange;
+
+static bool compare_title_changes(const TitleChange& first,
+                                  const TitleChange& second)
+{
+  return strcmp(first.first, second.first) < 0;
+}
+
+/*
+ * Converts a {file_id: title} mapping. IDs and titles are copied to the
+ * arena, so they're valid while the GIL is released.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool python_to_title_changes(PyObject* titles,
+                                    libtocc_python::StringArena& arena,
+                                    std::vector<TitleChange>& changes)
+{
+  PyObject* titles_dict = python_mapping_to_dict(
+      titles, "Expected a mapping of file IDs to titles.");
+  if (titles_dict == NULL)
+  {
+    return false;
+  }
+  libtocc_python::PyObjectHolder titles_dict_holder(titles_dict);
+
+  changes.reserve(PyDict_Size(titles_dict));
+
+  Py_ssize_t position = 0;
+  PyObject* file_id;
+  PyObject* title;
+  while (PyDict_Next(titles_dict, &position, &file_id, &title))
+  {
+    Py_ssize_t file_id_size;
+    const char* file_id_str =
+        libtocc_python::python_unicode_to_char(file_id, &file_id_size);
+    if (file_id_str == NULL)
+    {
+      return false;
+    }
+    Py_ssize_t title_size;
+    const char* title_str =
+        libtocc_python::python_unicode_to_char(title, &title_size);
+    if (title_str == NULL)
+    {
+      return false;
+    }
+
+    changes.push_back(TitleChange(arena.copy(title_str, title_size),
+                                  arena.copy(file_id_str, file_id_size)));
+  }
+
+  return true;
+}
+
+/*
+ * Sets the titles, with one libtocc call for each distinct title.
+ * Changes should be sorted by title.
+ */
+static void manager_locked_set_titles(ManagerObject* self,
+                                      std::vector<TitleChange>& changes,
+                                      std::vector<const char*>& file_ids)
+{
+  size_t group_start = 0;
+  while (group_start < changes.size())
+  {
+    const char* title = changes[group_start].first;
+    size_t group_end = group_start + 1;
+    while (group_end < changes.size() &&
+           strcmp(changes[group_end].first, title) == 0)
+    {
+      group_end++;
+    }
+
+    self->manager_instance->set_titles(&file_ids[group_start],
+                                       (int)(group_end - group_start), title);
+    group_start = group_end;
+  }
+}
+
+static PyObject* manager_set_titles(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                    PyObject* kwnames)
+{
+  static const char* kwlist[] = { "titles", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("set_titles", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  // Keeps the IDs and titles until the libtocc calls return.
+  libtocc_python::StringArena arena;
+  std::vector<TitleChange> changes;
+  if (!python_to_title_changes(values[0], arena, changes))
+  {
+    return NULL;
+  }
+  if (changes.empty())
+  {
+    Py_RETURN_NONE;
+  }
+
+  libtocc_python::EditBatch* batch = manager_get_batch(self);
+  if (batch != NULL)
+  {
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+      batch->set_title(changes[i].second, changes[i].first);
+    }
+    Py_RETURN_NONE;
+  }
+
+  // Files with the same title will be next to each other.
+  std::sort(changes.begin(), changes.end(), compare_title_changes);
+  std::vector<const char*> file_ids;
+  file_ids.reserve(changes.size());
+  for (size_t i = 0; i < changes.size(); i++)
+  {
+    file_ids.push_back(changes[i].second);
+  }
+
+  try
+  {
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    manager_locked_set_titles(self, changes, file_ids);
+  }
+  catch (libtocc::BaseException& error)
+  {
+    manager_invalidate_files(self, &file_ids[0], (int)file_ids.size());
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  manager_invalidate_files(self, &file_ids[0], (int)file_ids.size());
+
+  Py_RETURN_NONE;
+}
+
+/*
+ * Adds a tag and its count to the statistics dict.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool add_tag_statistics(PyObject* statistics_dict, const char* tag,
+                               unsigned int assigned_files)
+{
+  PyObject* key = PyUnicode_FromString(tag);
+  if (key == NULL)
+  {
+    return false;
+  }
+  libtocc_python::PyObjectHolder key_holder(key);
+
+  PyObject* value = PyLong_FromUnsignedLong(assigned_files);
+  if (value == NULL)
+  {
+    return false;
+  }
+  libtocc_python::PyObjectHolder value_holder(value);
+
+  return PyDict_SetItem(statistics_dict, key, value) == 0;
+}
+
+/*
+ * Tags and their counts, copied from libtocc's statistics or the
+ * TagsTable, so they can be filtered and sorted before any Python
+ * objects are created.
+ */
+typedef std::vector<std::pair<std::string, unsigned int> > TagCountsList;
+
+/*
+ * How get_tags_statistics returns its result.
+ */
+enum TagsStatisticsSort
+{
+  // A dict, not sorted.
+  TAGS_STATISTICS_DICT,
+  // A list, most used tags first.
+  TAGS_STATISTICS_SORT_COUNT,
+  // A list, sorted by tag.
+  TAGS_STATISTICS_SORT_TAG
+};
+
+/*
+ * Options of get_tags_statistics.
+ */
+struct TagsStatisticsOptions
+{
+  const char* prefix;
+  size_t prefix_size;
+  TagsStatisticsSort sort;
+  // -1 means no limit.
+  Py_ssize_t limit;
+};
+
+/*
+ * Orders tags by their count, most used first. Tags with the same
+ * count are ordered alphabetically.
+ */
+static bool compare_tag_counts(const std::pair<std::string, unsigned int>& first,
+                               const std::pair<std::string, unsigned int>& second)
+{
+  if (first.second != second.second)
+  {
+    return first.second > second.second;
+  }
+  return first.first < second.first;
+}
+
+/*
+ * Sorts and truncates the list, according to the options.
+ * Only the first `limit' items are sorted.
+ */
+static void sort_tag_counts(TagCountsList& tag_counts,
+                            const TagsStatisticsOptions& options)
+{
+  size_t size = tag_counts.size();
+  if (options.limit >= 0 && (size_t)options.limit < size)
+  {
+    size = options.limit;
+  }
+
+  if (options.sort == TAGS_STATISTICS_SORT_COUNT)
+  {
+    std::partial_sort(tag_counts.begin(), tag_counts.begin() + size,
+                      tag_counts.end(), compare_tag_counts);
+  }
+  else if (options.sort == TAGS_STATISTICS_SORT_TAG)
+  {
+    std::partial_sort(tag_counts.begin(), tag_counts.begin() + size,
+                      tag_counts.end());
+  }
+
+  tag_counts.resize(size);
+}
+
+/*
+ * Copies the tags that match the prefix from the statistics, and sorts
+ * them.
+ */
+static void statistics_to_tag_counts(libtocc::TagStatisticsCollection& statistics,
+                                     const TagsStatisticsOptions& options,
+                                     TagCountsList& tag_counts)
+{
+  tag_counts.reserve(statistics.size());
+
+  libtocc::TagStatisticsCollection::Iterator iterator(&statistics);
+  for (; !iterator.is_finished(); iterator.next())
+  {
+    libtocc::TagStatistics item = iterator.get();
+    if (strncmp(item.get_tag(), options.prefix, options.prefix_size) == 0)
+    {
+      tag_counts.push_back(std::make_pair(std::string(item.get_tag()),
+                                          item.get_assigned_files()));
+    }
+  }
+
+  sort_tag_counts(tag_counts, options);
+}
+
+/*
+ * Copies the tags that match the prefix from the table, and sorts them.
+ */
+static void table_to_tag_counts(libtocc_python::TagsTable& table,
+                                const TagsStatisticsOptions& options,
+                                TagCountsList& tag_counts)
+{
+  const libtocc_python::TagsTable::CountsMap& counts = table.get_counts();
+
+  // Table is sorted by tag, so tags of the prefix are next to each other.
+  libtocc_python::TagsTable::CountsMap::const_iterator iterator =
+      counts.lower_bound(std::string(options.prefix, options.prefix_size));
+  for (; iterator != counts.end(); ++iterator)
+  {
+    if (iterator->first.compare(0, options.prefix_size, options.prefix,
+                                options.prefix_size) != 0)
+    {
+      break;
+    }
+    if (options.sort == TAGS_STATISTICS_SORT_TAG && options.limit >= 0 &&
+        tag_counts.size() >= (size_t)options.limit)
+    {
+      // Already sorted by tag.
+      break;
+    }
+    tag_counts.push_back(*iterator);
+  }
+
+  sort_tag_counts(tag_counts, options);
+}
+
+/*
+ * Returns the tags table, and seeds it if it's not seeded yet.
+ * It should be called while the lock is held.
+ *
+ * It throws libtocc exceptions.
+ */
+static libtocc_python::TagsTable& manager_seeded_tags_table(ManagerObject* self)
+{
+  if (!self->tags_table->is_seeded())
+  {
+    libtocc::TagStatisticsCollection statistics =
+        self->manager_instance->get_tags_statistics();
+    self->tags_table->seed(statistics);
+  }
+
+  return *self->tags_table;
+}
+
+/*
+ * Collects statistics of the specified files. If no files specified,
+ * collects statistics of all of the files. Then, if tags are tracked,
+ * it's read from the tags table, without querying the database.
+ */
+static void manager_locked_tags_statistics(ManagerObject* self,
+                                           const char** file_ids,
+                                           int file_ids_size,
+                                           const TagsStatisticsOptions& options,
+                                           TagCountsList& tag_counts)
+{
+  if (file_ids_size > 0)
+  {
+    libtocc::TagStatisticsCollection statistics =
+        self->manager_instance->get_tags_statistics(file_ids, file_ids_size);
+    statistics_to_tag_counts(statistics, options, tag_counts);
+    return;
+  }
+
+  if (self->tags_table == NULL)
+  {
+    libtocc::TagStatisticsCollection statistics =
+        self->manager_instance->get_tags_statistics();
+    statistics_to_tag_counts(statistics, options, tag_counts);
+    return;
+  }
+
+  // Copying, since the table can't be used after the lock is released.
+  table_to_tag_counts(manager_seeded_tags_table(self), options, tag_counts);
+}
+
+/*
+ * Converts the collected statistics to a dict, or to a list of
+ * (tag, count) if they're sorted.
+ */
+static PyObject* tag_counts_to_python(TagCountsList& tag_counts,
+                                      const TagsStatisticsOptions& options)
+{
+  if (options.sort == TAGS_STATISTICS_DICT)
+  {
+    PyObject* result = PyDict_New();
+    if (result == NULL)
+    {
+      return NULL;
+    }
+
+    for (size_t i = 0; i < tag_counts.size(); i++)
+    {
+      if (!add_tag_statistics(result, tag_counts[i].first.c_str(),
+                              tag_counts[i].second))
+      {
+        Py_DECREF(result);
+        return NULL;
+      }
+    }
+
+    return result;
+  }
+
+  PyObject* result = PyList_New(tag_counts.size());
+  if (result == NULL)
+  {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < tag_counts.size(); i++)
+  {
+    PyObject* item = Py_BuildValue("(sk)", tag_counts[i].first.c_str(),
+                                   (unsigned long)tag_counts[i].second);
+    if (item == NULL)
+    {
+      Py_DECREF(result);
+      return NULL;
+    }
+    PyList_SET_ITEM(result, i, item);
+  }
+
+  return result;
+}
+
+/*
+ * Parses `limit', `prefix' and `sort' arguments of get_tags_statistics.
+ *
+ * @return: false if they're invalid. It sets the Python Error.
+ */
+static bool python_to_tags_statistics_options(PyObject* limit, PyObject* prefix,
+                                              PyObject* sort,
+                                              TagsStatisticsOptions& options)
+{
+  options.prefix = "";
+  options.prefix_size = 0;
+  options.sort = TAGS_STATISTICS_DICT;
+  options.limit = -1;
+
+  if (limit != NULL && limit != Py_None)
+  {
+    if (!libtocc_python::python_to_ssize_t(limit, &options.limit))
+    {
+      return false;
+    }
+    if (options.limit < 0)
+    {
+      PyErr_SetString(PyExc_ValueError, "limit can't be negative.");
+      return false;
+    }
+    options.sort = TAGS_STATISTICS_SORT_COUNT;
+  }
+
+  if (prefix != NULL && prefix != Py_None)
+  {
+    Py_ssize_t prefix_size;
+    options.prefix = libtocc_python::python_unicode_to_char(prefix, &prefix_size);
+    if (options.prefix == NULL)
+    {
+      return false;
+    }
+    options.prefix_size = prefix_size;
+    options.sort = TAGS_STATISTICS_SORT_COUNT;
+  }
+
+  if (sort != NULL && sort != Py_None)
+  {
+    const char* sort_str = libtocc_python::python_unicode_to_char(sort);
+    if (sort_str == NULL)
+    {
+      return false;
+    }
+    if (strcmp(sort_str, "count") == 0)
+    {
+      options.sort = TAGS_STATISTICS_SORT_COUNT;
+    }
+    else if (strcmp(sort_str, "tag") == 0)
+    {
+      options.sort = TAGS_STATISTICS_SORT_TAG;
+    }
+    else
+    {
+      PyErr_Format(PyExc_ValueError,
+                   "sort should be \"count\" or \"tag\". Found: %s",
+                   sort_str);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Converts the `files' argument of get_tags_statistics to an array of
+ * IDs. The array is empty if no files are specified.
+ *
+ * @param argument: None (or NULL), a File ID, a FileInfo, or a collection
+ *   of them.
+ * @param arena: The array and the IDs are copied to this arena.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
  */
-static int manager_init(ManagerObject* self, PyObject* args, PyObject* kwargs)
+static bool python_to_statistics_files(PyObject* argument,
+                                       libtocc_python::StringArena& arena,
+                                       const char*** out_array,
+                                       int* out_size)
 {
-  char* base_path;
-  static char* kwlist[] = { "base_path", NULL };
+  if (argument == NULL || argument == Py_None)
+  {
+    // No argument passed.
+    *out_array = NULL;
+    *out_size = 0;
+    return true;
+  }
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                   "s",
-                                   kwlist,
-                                   &base_path))
+  const char* file_id = NULL;
+  Py_ssize_t file_id_size = 0;
+  if (PyUnicode_Check(argument))
   {
-    return -1;
+    // Argument is a single string.
+    file_id = libtocc_python::python_unicode_to_char(argument, &file_id_size);
+    if (file_id == NULL)
+    {
+      return false;
+    }
+  }
+  else if (is_python_file_info(argument))
+  {
+    // Argument is a single file info.
+    file_id = python_file_info_get(argument)->get_id();
+    file_id_size = strlen(file_id);
   }
 
-  self->manager_instance = new libtocc::Manager(base_path);
+  if (file_id != NULL)
+  {
+    *out_array = (const char**)arena.allocate(sizeof(char*));
+    (*out_array)[0] = arena.copy(file_id, file_id_size);
+    *out_size = 1;
+    return true;
+  }
 
-  return 0;
+  // Argument is a collection of file infos or Unicodes.
+  // Empty collection means all of the files.
+  return create_file_ids_array(argument, arena, out_array, out_size);
 }
 
 /*
- * Destructor.
+ * Parameters of get_tags_statistics.
  */
-static void manager_object_dealloc(ManagerObject* self)
+static const char* get_tags_statistics_kwlist[] = { "files", "limit", "prefix",
+                                                    "sort", NULL };
+
+static PyObject* manager_get_tags_statistics(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                             PyObject* kwnames)
 {
-  if (self->manager_instance != NULL)
+  PyObject* values[4];
+
+  if (!libtocc_python::unpack_fastcall_args("get_tags_statistics", args, nargs,
+                                            kwnames, get_tags_statistics_kwlist,
+                                            0, values))
   {
-    delete self->manager_instance;
-    self->manager_instance = NULL;
+    return NULL;
   }
-  PyObject_Del(self);
-}
 
-static PyObject* manager_initialize(ManagerObject* self)
-{
+  TagsStatisticsOptions options;
+  if (!python_to_tags_statistics_options(values[1], values[2], values[3],
+                                         options))
+  {
+    return NULL;
+  }
+
+  libtocc_python::StringArena arena;
+  const char** file_ids_array;
+  int file_ids_size;
+  if (!python_to_statistics_files(values[0], arena, &file_ids_array,
+                                  &file_ids_size))
+  {
+    return NULL;
+  }
+
+  TagCountsList tag_counts;
+
   try
   {
-    self->manager_instance->initialize();
-    Py_RETURN_NONE;
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    manager_locked_tags_statistics(self, file_ids_array, file_ids_size,
+                                   options, tag_counts);
   }
   catch (libtocc::BaseException& error)
   {
-    // TODO
+    libtocc_python::set_libtocc_error(error);
     return NULL;
   }
+
+  return tag_counts_to_python(tag_counts, options);
 }
 
-static PyObject* manager_get_file_info(ManagerObject* self, PyObject* args)
+static PyObject* manager_complete_tags(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                       PyObject* kwnames)
 {
-  char* file_id;
+  static const char* kwlist[] = { "prefix", "limit", NULL };
+  PyObject* values[2];
+
+  if (!libtocc_python::unpack_fastcall_args("complete_tags", args, nargs,
+                                            kwnames, kwlist, 1, values))
+  {
+    return NULL;
+  }
 
-  if (!PyArg_ParseTuple(args, "s", &file_id))
+  TagsStatisticsOptions options;
+  if (!python_to_tags_statistics_options(values[1], values[0], NULL, options))
   {
     return NULL;
   }
+  options.sort = TAGS_STATISTICS_SORT_TAG;
+
+  TagCountsList tag_counts;
+  bool tracked = false;
 
   try
   {
-    return create_python_file_info(self->manager_instance->get_file_info(file_id));
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+
+    // Tags are completed from the table. Turning on tracking here would
+    // silently change what the other calls return, so it's left to the
+    // user.
+    if (self->tags_table != NULL)
+    {
+      tracked = true;
+      table_to_tag_counts(manager_seeded_tags_table(self), options, tag_counts);
+    }
   }
   catch (libtocc::BaseException& error)
   {
-    // TODO
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+
+  if (!tracked)
+  {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "complete_tags needs a Manager created with track_tags=True.");
+    return NULL;
+  }
+
+  PyObject* result = PyList_New(tag_counts.size());
+  if (result == NULL)
+  {
     return NULL;
   }
+
+  for (size_t i = 0; i < tag_counts.size(); i++)
+  {
+    PyObject* tag = PyUnicode_FromString(tag_counts[i].first.c_str());
+    if (tag == NULL)
+    {
+      Py_DECREF(result);
+      return NULL;
+    }
+    PyList_SET_ITEM(result, i, tag);
+  }
+
+  return result;
 }
 
-static PyObject* manager_get_file_by_traditional_path(ManagerObject* self, PyObject* args)
+/*
+ * Gets the libtocc::Query of the specified object.
+ *
+ * @param query: A PreparedQuery, or a query expression.
+ * @param compiled_query: If `query' is an expression, it will be compiled
+ *   and this will point to the result. Caller should delete it.
+ *   Otherwise, it will be NULL.
+ *
+ * @return: NULL if any errors happen. It sets the Python Error.
+ */
+static libtocc::Query* python_to_query(PyObject* query,
+                                       libtocc::Query** compiled_query)
 {
-  char* traditional_path;
+  *compiled_query = NULL;
+
+  if (is_python_prepared_query(query))
+  {
+    return python_prepared_query_get(query);
+  }
+
+  *compiled_query = compile_python_query(query);
+  return *compiled_query;
+}
 
-  if (!PyArg_ParseTuple(args, "s", &traditional_path))
+/*
+ * Searches for the specified query with the GIL released.
+ *
+ * @param query_object: A PreparedQuery, or a query expression.
+ *
+ * @return: Found files. NULL if any errors happen, it sets the
+ *   Python Error.
+ *   Note that you should delete the return pointer when you finished
+ *   with it.
+ */
+static libtocc::FileInfoCollection* manager_run_query(ManagerObject* self,
+                                                      PyObject* query_object)
+{
+  libtocc::Query* compiled_query;
+  libtocc::Query* query = python_to_query(query_object, &compiled_query);
+  if (query == NULL)
   {
     return NULL;
   }
 
+  libtocc::FileInfoCollection* result = NULL;
+
   try
   {
-    return create_python_file_info(
-        self->manager_instance->get_file_by_traditional_path(traditional_path));
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    result = new libtocc::FileInfoCollection(
+        self->manager_instance->search_files(*query));
   }
   catch (libtocc::BaseException& error)
   {
-    // TODO
+    delete compiled_query;
+    libtocc_python::set_libtocc_error(error);
     return NULL;
   }
+
+  delete compiled_query;
+
+  return result;
 }
 
-static PyObject* manager_import_file(ManagerObject* self, PyObject* args, PyObject* kwargs)
+/*
+ * Counts the files that match the query, with the GIL released. Found
+ * files are only counted, so they're not copied to the heap.
+ *
+ * @param query_object: A PreparedQuery, or a query expression.
+ *
+ * @return: false if any errors happen. It sets the Python Error.
+ */
+static bool manager_count_query(ManagerObject* self, PyObject* query_object,
+                                unsigned int* out_count)
 {
-  char* source_path;
-  char* title = "";
-  char* traditional_path = "";
-  PyObject* tags_list = NULL;
-
-  static char* kwlist[] = { "source_path", "title", "traditional_path",
-                             "tags", NULL };
+  libtocc::Query* compiled_query;
+  libtocc::Query* query = python_to_query(query_object, &compiled_query);
+  if (query == NULL)
+  {
+    return false;
+  }
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs,
-                                   "s|ssO",
-                                   kwlist,
-                                   &source_path,
-                                   &title,
-                                   &traditional_path,
-                                   &tags_list))
+  try
   {
-    return NULL;
+    libtocc_python::GILReleaser gil_releaser(self->lock);
+    *out_count = self->manager_instance->search_files(*query).size();
+  }
+  catch (libtocc::BaseException& error)
+  {
+    delete compiled_query;
+    libtocc_python::set_libtocc_error(error);
+    return false;
   }
 
-  libtocc_python::PyObjectHolder(tags_list, true);
+  delete compiled_query;
 
-  libtocc::TagsCollection* tags_collection = NULL;
+  return true;
+}
 
-  try
+/*
+ * Parameters of search.
+ */
+static const char* search_kwlist[] = { "query", "limit", "offset", NULL };
+
+/*
+ * Converts `limit' and `offset' arguments of search.
+ *
+ * @return: false if they're invalid. It sets the Python Error.
+ */
+static bool python_to_search_range(PyObject** values,
+                                   Py_ssize_t* out_limit, Py_ssize_t* out_offset)
+{
+  // -1 means no limit.
+  *out_limit = -1;
+  if (values[1] != NULL && values[1] != Py_None)
   {
-    if (tags_list == NULL || tags_list == Py_None ||
-        (PyList_Check(tags_list) && PyList_Size(tags_list) <= 0))
+    if (!libtocc_python::python_to_ssize_t(values[1], out_limit))
     {
-      // Using the other overload without tags.
-      libtocc::FileInfo result =
-          self->manager_instance->import_file(source_path, title, traditional_path);
-      return create_python_file_info(result);
+      return false;
     }
-    else
+    if (*out_limit < 0)
     {
-      if (!PyList_Check(tags_list))
-      {
-        // TODO: Raise exception.
-      }
+      PyErr_SetString(PyExc_ValueError, "limit can't be negative.");
+      return false;
+    }
+  }
+  *out_offset = 0;
+  if (values[2] != NULL && !libtocc_python::python_to_ssize_t(values[2], out_offset))
+  {
+    return false;
+  }
 
-      // Creating a tags collection from the list of tags.
-      tags_collection = libtocc_python::tags_list_to_collection(tags_list);
+  if (*out_offset < 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "offset can't be negative.");
+    return false;
+  }
 
-      // Importing file.
-      libtocc::FileInfo result =
-          self->manager_instance->import_file(source_path, title,
-                                              traditional_path,
-                                              tags_collection);
+  return true;
+}
 
-      delete tags_collection;
-      tags_collection = NULL;
+static PyObject* manager_search(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                PyObject* kwnames)
+{
+  PyObject* values[3];
 
-      return create_python_file_info(result);
-    }
+  if (!libtocc_python::unpack_fastcall_args("search", args, nargs, kwnames,
+                                            search_kwlist, 1, values))
+  {
+    return NULL;
   }
-  catch (libtocc::BaseException& error)
+
+  PyObject* query_object = values[0];
+  Py_ssize_t limit;
+  Py_ssize_t offset;
+  if (!python_to_search_range(values, &limit, &offset))
   {
-    // TODO
-    if (tags_collection != NULL)
-    {
-      delete tags_collection;
-    }
+    return NULL;
   }
+
+  libtocc::FileInfoCollection* result = manager_run_query(self, query_object);
+  if (result == NULL)
+  {
+    return NULL;
+  }
+
+  // Iterator takes the ownership of the collection.
+  return create_python_file_info_iterator(result, offset, limit);
 }
 
-static PyObject* manager_remove_file(ManagerObject* self, PyObject* args)
+static PyObject* manager_count(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                               PyObject* kwnames)
 {
-  char* file_id;
+  static const char* kwlist[] = { "query", NULL };
+  PyObject* values[1];
 
-  if (!PyArg_ParseTuple(args, "s", file_id))
+  if (!libtocc_python::unpack_fastcall_args("count", args, nargs, kwnames,
+                                            kwlist, 1, values))
   {
     return NULL;
   }
 
-  try
+  unsigned int result_size;
+  if (!manager_count_query(self, values[0], &result_size))
   {
-    self->manager_instance->remove_file(file_id);
+    return NULL;
+  }
 
-    Py_RETURN_NONE;
+  return PyLong_FromUnsignedLong(result_size);
+}
+
+static PyObject* manager_search_ids(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                    PyObject* kwnames)
+{
+  static const char* kwlist[] = { "query", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("search_ids", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
   }
-  catch(libtocc::BaseException& error)
+
+  PyObject* query_object = values[0];
+
+  libtocc::FileInfoCollection* result = manager_run_query(self, query_object);
+  if (result == NULL)
+  {
+    return NULL;
+  }
+
+  PyObject* ids_tuple = PyTuple_New(result->size());
+  if (ids_tuple == NULL)
+  {
+    delete result;
+    return NULL;
+  }
+
+  int tuple_index = 0;
+  libtocc::FileInfoCollection::Iterator iterator(result);
+  for (; !iterator.is_finished(); iterator.next())
   {
-    // TODO
+    // IDs aren't interned: interned strings live as long as the
+    // interpreter, so a long running process would keep every ID it
+    // ever returned.
+    PyObject* file_id = PyUnicode_FromString(iterator.get()->get_id());
+    if (file_id == NULL)
+    {
+      delete result;
+      Py_DECREF(ids_tuple);
+      return NULL;
+    }
+    PyTuple_SET_ITEM(ids_tuple, tuple_index, file_id);
+    tuple_index++;
   }
+
+  delete result;
+
+  return ids_tuple;
 }
 
-static PyObject* manager_remove_files(ManagerObject* self, PyObject* args)
+/*
+ * Base of the async tasks of Manager. It keeps the Manager alive until
+ * the task is finished, and holds the Manager's lock while the task runs,
+ * like the GILReleaser of the blocking methods.
+ */
+class ManagerTask : public libtocc_python::AsyncTask
 {
-  // Note that files_list is a borrowed reference,
-  // we do not touch its reference count.
-  PyObject* files_list;
+public:
+  /*
+   * @param take_lock: If false, the lock isn't held while the task runs,
+   *   and the task should take it itself (e.g. it calls the
+   *   `manager_unlocked_' functions).
+   */
+  ManagerTask(ManagerObject* manager, bool take_lock = true)
+  {
+    this->manager = manager;
+    this->take_lock = take_lock;
+    Py_INCREF(this->manager);
+  }
 
-  if (!PyArg_ParseTuple(args, "O", files_list))
+  virtual ~ManagerTask()
   {
-    return NULL;
+    Py_DECREF(this->manager);
   }
 
-  if (!PyList_Check(files_list))
+  virtual void run()
   {
-    // TODO: set exception.
-    return NULL;
+    libtocc_python::LockHolder lock_holder(
+        this->take_lock ? this->manager->lock : NULL);
+    run_locked();
   }
 
-  libtocc::FileInfoCollection* file_infos = NULL;
+protected:
+  /*
+   * Does the work, while the lock is held (unless `take_lock' is false)
+   * and the GIL is released.
+   */
+  virtual void run_locked() = 0;
 
-  try
+  ManagerObject* manager;
+
+private:
+  bool take_lock;
+};
+
+class GetFileInfoTask : public ManagerTask
+{
+public:
+  GetFileInfoTask(ManagerObject* manager, const char* file_id,
+                  unsigned long cache_generation)
+    : ManagerTask(manager), file_id(file_id)
   {
-    file_infos = libtocc_python::file_ids_to_info_collection(files_list);
+    this->cache_generation = cache_generation;
+    this->result = NULL;
+  }
 
-    // Calling manager by the created collection.
-    self->manager_instance->remove_files(*file_infos);
+  virtual ~GetFileInfoTask()
+  {
+    delete this->result;
+  }
 
-    delete file_infos;
+  virtual void run_locked()
+  {
+    this->result = new libtocc::FileInfo(
+        this->manager->manager_instance->get_file_info(this->file_id.c_str()));
+  }
 
-    Py_RETURN_NONE;
+  virtual PyObject* get_result()
+  {
+    PyObject* python_result = create_python_file_info(*this->result);
+    if (python_result != NULL && this->manager->file_info_cache != NULL)
+    {
+      this->manager->file_info_cache->insert(this->cache_generation,
+                                             *this->result, python_result);
+    }
+    return python_result;
   }
-  catch (libtocc::BaseException& error)
+
+private:
+  std::string file_id;
+  unsigned long cache_generation;
+  libtocc::FileInfo* result;
+};
+
+class ImportFileTask : public ManagerTask
+{
+public:
+  /*
+   * Task takes the ownership of the record's tags.
+   */
+  ImportFileTask(ManagerObject* manager, const ImportRecord& record)
+    : ManagerTask(manager, false), record(record)
+  {
+    this->result = NULL;
+  }
+
+  virtual ~ImportFileTask()
+  {
+    delete this->record.tags;
+    delete this->result;
+  }
+
+  virtual void run_locked()
+  {
+    this->result = new libtocc::FileInfo(
+        manager_unlocked_import_file(this->manager,
+                                     this->record.source_path.c_str(),
+                                     this->record.title.c_str(),
+                                     this->record.traditional_path.c_str(),
+                                     this->record.tags,
+                                     this->record.options));
+  }
+
+  virtual void finish()
   {
-    // TODO
-    if (file_infos != NULL)
+    manager_invalidate_traditional_path(this->manager,
+                                        this->record.traditional_path.c_str());
+    if (this->record.options.dedup && this->result != NULL)
     {
-      delete file_infos;
+      // Tags of an existing file may be changed.
+      const char* file_id = this->result->get_id();
+      manager_invalidate_files(this->manager, &file_id, 1);
     }
+  }
 
+  virtual PyObject* get_result()
+  {
+    return create_python_file_info(*this->result);
   }
-}
 
-static PyObject* manager_assign_tags(ManagerObject* self, PyObject* args)
+private:
+  ImportRecord record;
+  libtocc::FileInfo* result;
+};
+
+class AssignTagsTask : public ManagerTask
 {
-  // Note that python objects are borrowed reference,
-  // we do not touch its reference count.
-  PyObject* files_list;
-  PyObject* tags_list;
+public:
+  /*
+   * Task takes the ownership of the collections.
+   */
+  AssignTagsTask(ManagerObject* manager, libtocc::FileInfoCollection* file_infos,
+                 libtocc::TagsCollection* tags)
+    : ManagerTask(manager)
+  {
+    this->file_infos = file_infos;
+    this->tags = tags;
+  }
 
-  if (!PyArg_ParseTuple(args, "OO", files_list, tags_list))
+  virtual ~AssignTagsTask()
   {
-    return NULL;
+    delete this->file_infos;
+    delete this->tags;
   }
 
-  if (!PyList_Check(files_list))
+  virtual void run_locked()
   {
-    // TODO: set exception.
-    return NULL;
+    manager_locked_assign_tags(this->manager, *this->file_infos, this->tags);
+  }
+
+  virtual void finish()
+  {
+    manager_invalidate_files(this->manager, *this->file_infos);
   }
-  if (!PyList_Check(tags_list))
+
+  virtual PyObject* get_result()
   {
-    // TODO: set exception.
-    return NULL;
+    Py_RETURN_NONE;
   }
 
+private:
   libtocc::FileInfoCollection* file_infos;
   libtocc::TagsCollection* tags;
+};
 
-  try
+class SearchTask : public ManagerTask
+{
+public:
+  /*
+   * @param query_object: Task keeps a reference to it, since `query' may
+   *   point inside it.
+   * @param compiled_query: Task takes its ownership. Can be NULL.
+   */
+  SearchTask(ManagerObject* manager, PyObject* query_object,
+             libtocc::Query* query, libtocc::Query* compiled_query,
+             Py_ssize_t offset, Py_ssize_t limit)
+    : ManagerTask(manager)
   {
-    file_infos = libtocc_python::file_ids_to_info_collection(files_list);
-    tags = libtocc_python::tags_list_to_collection(tags_list);
+    this->query_object = query_object;
+    Py_INCREF(this->query_object);
+    this->query = query;
+    this->compiled_query = compiled_query;
+    this->offset = offset;
+    this->limit = limit;
+    this->result = NULL;
+  }
 
-    self->manager_instance->assign_tags(*file_infos, tags);
+  virtual ~SearchTask()
+  {
+    delete this->result;
+    delete this->compiled_query;
+    Py_DECREF(this->query_object);
+  }
 
-    delete file_infos;
-    delete tags;
+  virtual void run_locked()
+  {
+    this->result = new libtocc::FileInfoCollection(
+        this->manager->manager_instance->search_files(*this->query));
+  }
 
-    Py_RETURN_NONE;
+  virtual PyObject* get_result()
+  {
+    // Iterator takes the ownership of the collection.
+    libtocc::FileInfoCollection* result = this->result;
+    this->result = NULL;
+    return create_python_file_info_iterator(result, this->offset, this->limit);
+  }
+
+private:
+  PyObject* query_object;
+  libtocc::Query* query;
+  libtocc::Query* compiled_query;
+  Py_ssize_t offset;
+  Py_ssize_t limit;
+  libtocc::FileInfoCollection* result;
+};
+
+class TagsStatisticsTask : public ManagerTask
+{
+public:
+  TagsStatisticsTask(ManagerObject* manager)
+    : ManagerTask(manager)
+  {
+    this->file_ids = NULL;
+    this->file_ids_size = 0;
+  }
+
+  /*
+   * Copies the arguments into the task, so they outlive the Python
+   * objects.
+   *
+   * @return: false if any errors happen. It sets the Python Error.
+   */
+  bool set_arguments(PyObject** values)
+  {
+    if (!python_to_tags_statistics_options(values[1], values[2], values[3],
+                                           this->options))
+    {
+      return false;
+    }
+    this->prefix.assign(this->options.prefix, this->options.prefix_size);
+    this->options.prefix = this->prefix.c_str();
+
+    return python_to_statistics_files(values[0], this->arena, &this->file_ids,
+                                      &this->file_ids_size);
+  }
+
+  virtual void run_locked()
+  {
+    manager_locked_tags_statistics(this->manager, this->file_ids,
+                                   this->file_ids_size, this->options,
+                                   this->tag_counts);
+  }
+
+  virtual PyObject* get_result()
+  {
+    return tag_counts_to_python(this->tag_counts, this->options);
+  }
+
+private:
+  libtocc_python::StringArena arena;
+  const char** file_ids;
+  int file_ids_size;
+  std::string prefix;
+  TagsStatisticsOptions options;
+  TagCountsList tag_counts;
+};
+
+static PyObject* manager_get_file_info_async(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                             PyObject* kwnames)
+{
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("get_file_info_async", args, nargs,
+                                            kwnames, get_file_info_kwlist, 1, values))
+  {
+    return NULL;
+  }
+  const char* file_id = libtocc_python::python_unicode_to_char(values[0]);
+  if (file_id == NULL)
+  {
+    return NULL;
   }
-  catch (libtocc::BaseException& error)
+
+  unsigned long cache_generation = 0;
+  if (self->file_info_cache != NULL)
   {
-    // TODO
-    if (file_infos != NULL)
+    PyObject* cached = self->file_info_cache->get_by_id(file_id);
+    if (cached != NULL)
     {
-      delete file_infos;
-    }
-    if (tags != NULL)
-    {
-      delete tags;
+      libtocc_python::PyObjectHolder cached_holder(cached);
+      return libtocc_python::create_completed_future(cached);
     }
+    cache_generation = self->file_info_cache->get_generation();
   }
 
+  return libtocc_python::submit_async_task(
+      new GetFileInfoTask(self, file_id, cache_generation));
 }
 
-static PyObject* manager_unassign_tags(ManagerObject* self, PyObject* args)
+static PyObject* manager_import_file_async(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                           PyObject* kwnames)
 {
-  // Note that python objects are borrowed reference,
-  // we do not touch its reference count.
-  PyObject* files_list;
-  PyObject* tags_list;
+  PyObject* values[6];
 
-  if (!PyArg_ParseTuple(args, "OO", files_list, tags_list))
+  if (!libtocc_python::unpack_fastcall_args("import_file_async", args, nargs,
+                                            kwnames, import_file_kwlist, 1, values))
   {
     return NULL;
   }
 
-  if (!PyList_Check(files_list))
+  const char* source_path;
+  const char* title;
+  const char* traditional_path;
+  ImportRecord record;
+  if (!python_to_import_file_args(values, &source_path, &title,
+                                  &traditional_path, &record.tags,
+                                  &record.options))
   {
-    // TODO: set exception.
     return NULL;
   }
-  if (!PyList_Check(tags_list))
+  record.source_path = source_path;
+  record.title = title;
+  record.traditional_path = traditional_path;
+
+  return libtocc_python::submit_async_task(new ImportFileTask(self, record));
+}
+
+static PyObject* manager_assign_tags_async(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                           PyObject* kwnames)
+{
+  PyObject* values[2];
+
+  if (!libtocc_python::unpack_fastcall_args("assign_tags_async", args, nargs,
+                                            kwnames, assign_tags_kwlist, 2, values))
   {
-    // TODO: set exception.
     return NULL;
   }
 
   libtocc::FileInfoCollection* file_infos;
   libtocc::TagsCollection* tags;
-
-  try
+  if (!python_to_tags_change_args(values, &file_infos, &tags))
   {
-    file_infos = libtocc_python::file_ids_to_info_collection(files_list);
-    tags = libtocc_python::tags_list_to_collection(tags_list);
+    return NULL;
+  }
 
-    self->manager_instance->unassign_tags(*file_infos, tags);
+  return libtocc_python::submit_async_task(
+      new AssignTagsTask(self, file_infos, tags));
+}
 
-    delete file_infos;
-    delete tags;
+static PyObject* manager_search_async(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                      PyObject* kwnames)
+{
+  PyObject* values[3];
 
-    Py_RETURN_NONE;
+  if (!libtocc_python::unpack_fastcall_args("search_async", args, nargs, kwnames,
+                                            search_kwlist, 1, values))
+  {
+    return NULL;
   }
-  catch (libtocc::BaseException& error)
+
+  Py_ssize_t limit;
+  Py_ssize_t offset;
+  if (!python_to_search_range(values, &limit, &offset))
   {
-    // TODO
-    if (file_infos != NULL)
-    {
-      delete file_infos;
-    }
-    if (tags != NULL)
-    {
-      delete tags;
-    }
+    return NULL;
   }
 
+  libtocc::Query* compiled_query;
+  libtocc::Query* query = python_to_query(values[0], &compiled_query);
+  if (query == NULL)
+  {
+    return NULL;
+  }
+
+  return libtocc_python::submit_async_task(
+      new SearchTask(self, values[0], query, compiled_query, offset, limit));
 }
 
-static PyObject* manager_set_title(ManagerObject* self, PyObject* args)
+static PyObject* manager_get_tags_statistics_async(ManagerObject* self, PyObject* const* args, Py_ssize_t nargs,
+                                                   PyObject* kwnames)
 {
-  // Note that file_ids is a borrowed reference,
-  // we do not touch its reference count.
-  PyObject* file_ids;
-  const char* title;
+  PyObject* values[4];
 
-  if (!PyArg_ParseTuple(args, "Os", file_ids, title))
+  if (!libtocc_python::unpack_fastcall_args("get_tags_statistics_async", args,
+                                            nargs, kwnames,
+                                            get_tags_statistics_kwlist, 0, values))
   {
     return NULL;
   }
 
-  try
+  TagsStatisticsTask* task = new TagsStatisticsTask(self);
+  if (!task->set_arguments(values))
   {
-    if (PyList_Check(file_ids))
-    {
-      char** file_ids_array = NULL;
-      if (!create_file_ids_array(file_ids, file_ids_array))
-      {
-        return NULL;
-      }
-
-      self->manager_instance->set_titles((const char**)file_ids_array, (int)PyList_Size(file_ids), title);
+    delete task;
+    return NULL;
+  }
 
-      // TODO: delete this if exception occurred.
-      delete[] file_ids_array;
-      file_ids_array = NULL;
-    }
-    else if (PyUnicode_Check(file_ids))
-    {
-      char* file_id_str = libtocc_python::python_unicode_to_char(file_ids);
-      if (file_id_str == NULL)
-      {
-        return NULL;
-      }
+  return libtocc_python::submit_async_task(task);
+}
 
-      self->manager_instance->set_title(file_id_str, title);
-    }
-    else
-    {
-      // TODO
-    }
+static PyObject* manager_cache_info(ManagerObject* self)
+{
+  libtocc_python::FileInfoCache* cache = self->file_info_cache;
 
-    Py_RETURN_NONE;
+  if (cache == NULL)
+  {
+    return Py_BuildValue("{s:k,s:k,s:k,s:n,s:n}",
+                         "hits", 0UL, "misses", 0UL, "evictions", 0UL,
+                         "size", (Py_ssize_t)0, "max_size", (Py_ssize_t)0);
   }
-  catch (libtocc::BaseException& error)
+
+  return Py_BuildValue("{s:k,s:k,s:k,s:n,s:n}",
+                       "hits", cache->get_hits(),
+                       "misses", cache->get_misses(),
+                       "evictions", cache->get_evictions(),
+                       "size", (Py_ssize_t)cache->get_size(),
+                       "max_size", (Py_ssize_t)cache->get_max_size());
+}
+
+static PyObject* manager_cache_clear(ManagerObject* self)
+{
+  if (self->file_info_cache != NULL)
   {
-    // TODO
+    self->file_info_cache->clear();
   }
+
+  Py_RETURN_NONE;
 }
 
-static PyObject* tags_statistics_to_dict(libtocc::TagStatisticsCollection* statistics)
+/*
+ * Defines a Python class, for the context manager returned by
+ * `Manager.batch()'.
+ */
+typedef struct
+{
+  PyObject_HEAD
+  ManagerObject* manager;
+  libtocc_python::EditBatch* edit_batch;
+  // True while the batch is entered.
+  bool active;
+  // The thread that entered the batch.
+  unsigned long thread_id;
+} BatchObject;
+
+/*
+ * Removes the batch from the active batches of its Manager.
+ */
+static void batch_deactivate(BatchObject* self)
 {
-  PyObject* result = PyDict_New();
+  self->active = false;
+  self->manager->active_batches->erase(self->thread_id);
+}
 
-  if (statistics->size() <= 0)
+/*
+ * Destructor.
+ */
+static void batch_object_dealloc(BatchObject* self)
+{
+  if (self->active)
   {
-    // Returning an empty dict.
-    return result;
+    batch_deactivate(self);
   }
+  delete self->edit_batch;
+  self->edit_batch = NULL;
+  Py_XDECREF(self->manager);
+  self->manager = NULL;
 
-  libtocc::TagStatisticsCollection::Iterator iterator(statistics);
+  PyObject_Del(self);
+}
 
-  for (; !iterator.is_finished(); iterator.next())
+static PyObject* batch_enter(BatchObject* self)
+{
+  if (self->active)
   {
-    libtocc::TagStatistics item = iterator.get();
-    PyDict_SetItem(result, PyUnicode_FromString(item.get_tag()), PyLong_FromLong(item.get_assigned_files()));
+    PyErr_SetString(PyExc_RuntimeError, "Batch is already entered.");
+    return NULL;
+  }
+  if (manager_get_batch(self->manager) != NULL)
+  {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Another batch is already active in this thread.");
+    return NULL;
   }
 
-  return result;
+  if (self->manager->active_batches == NULL)
+  {
+    self->manager->active_batches =
+        new std::map<unsigned long, libtocc_python::EditBatch*>();
+  }
+  self->active = true;
+  self->thread_id = PyThread_get_thread_ident();
+  (*self->manager->active_batches)[self->thread_id] = self->edit_batch;
+
+  Py_INCREF(self);
+  return (PyObject*)self;
 }
 
-PyObject* manager_get_tags_statistics(ManagerObject* self, PyObject* args, PyObject* kwargs)
+static PyObject* batch_exit(BatchObject* self, PyObject* const* args, Py_ssize_t nargs,
+                            PyObject* kwnames)
 {
-  PyObject* argument = NULL;
+  static const char* kwlist[] = { "exc_type", "exc_value", "traceback", NULL };
+  PyObject* values[3];
 
-  char* kwlist[] = { "files" };
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &argument))
+  if (!libtocc_python::unpack_fastcall_args("__exit__", args, nargs, kwnames,
+                                            kwlist, 3, values))
   {
     return NULL;
   }
 
-  if (argument == NULL || argument == Py_None ||
-      (PyList_Check(argument) && PyList_Size(argument) <= 0))
+  if (!self->active)
   {
-    // No argument passed.
-    libtocc::TagStatisticsCollection statistics =
-        self->manager_instance->get_tags_statistics();
-    return tags_statistics_to_dict(&statistics);
+    PyErr_SetString(PyExc_RuntimeError, "Batch is not entered.");
+    return NULL;
   }
-  if (PyUnicode_Check(argument))
-  {
-    // Argument is a single string.
-    libtocc::FileInfo file_info(libtocc_python::python_unicode_to_char(argument));
-    libtocc::FileInfoCollection files_collection;
-    files_collection.add_file_info(file_info);
 
-    libtocc::TagStatisticsCollection statistics =
-        self->manager_instance->get_tags_statistics(files_collection);
-    return tags_statistics_to_dict(&statistics);
+  bool succeed = true;
+  if (values[0] == Py_None)
+  {
+    // The batch stays active while it's flushed, so it can't be entered
+    // again meanwhile.
+    succeed = manager_flush_batch(self->manager, *self->edit_batch);
   }
-  if (is_python_file_info(argument))
+  else
   {
-    // Argument is a single file info.
-    libtocc::FileInfo* file_info =
-        python_file_info_get(argument);
+    // Block raised an exception. Nothing is applied.
+    self->edit_batch->clear();
+  }
 
-    libtocc::FileInfoCollection files_collection;
-    files_collection.add_file_info(*file_info);
+  batch_deactivate(self);
 
-    libtocc::TagStatisticsCollection statistics =
-        self->manager_instance->get_tags_statistics(files_collection);
-    return tags_statistics_to_dict(&statistics);
+  if (!succeed)
+  {
+    return NULL;
   }
-  if (PyList_Check(argument))
+  Py_RETURN_FALSE;
+}
+
+static PyObject* batch_get_queued(BatchObject* self)
+{
+  return PyLong_FromUnsignedLong(self->edit_batch->get_queued());
+}
+
+static PyObject* batch_get_coalesced(BatchObject* self)
+{
+  return PyLong_FromUnsignedLong(self->edit_batch->get_coalesced());
+}
+
+static PyObject* batch_get_calls(BatchObject* self)
+{
+  return PyLong_FromUnsignedLong(self->edit_batch->get_calls());
+}
+
+/*
+ * Methods of Batch class.
+ */
+static PyMethodDef batch_methods[] =
+{
   {
-    // Argument is a list of file info or a list of Unicode.
-    char** file_ids_array;
-    if (!create_file_ids_array(argument, file_ids_array))
-    {
-      return NULL;
-    }
+    "__enter__", (PyCFunction)batch_enter, METH_NOARGS,
+    PyDoc_STR("Starts queueing the edits.")
+  },
+  {
+    "__exit__", (PyCFunction)batch_exit, METH_FASTCALL | METH_KEYWORDS,
+    PyDoc_STR("Applies the queued edits, or discards them if the block\n"
+              "raised an exception.")
+  },
+  {NULL, NULL}
+};
 
-    libtocc::TagStatisticsCollection statistics =
-        self->manager_instance->get_tags_statistics((const char**)file_ids_array,
-                                                    PyList_Size(argument));
-    return tags_statistics_to_dict(&statistics);
+/*
+ * Read-only attributes of Batch class.
+ */
+static PyGetSetDef batch_getset[] =
+{
+  {
+    "queued", (getter)batch_get_queued, NULL,
+    PyDoc_STR("Number of the queued edits. A call adds an edit for each\n"
+              "file and tag (or title). (int)")
+  },
+  {
+    "coalesced", (getter)batch_get_coalesced, NULL,
+    PyDoc_STR("Number of the edits that are replaced by a later edit of\n"
+              "the same file and tag (or title). (int)")
+  },
+  {
+    "calls", (getter)batch_get_calls, NULL,
+    PyDoc_STR("Number of the libtocc calls that applied the edits. (int)")
+  },
+  {NULL}
+};
+
+/*
+ * Definition of Type.
+ */
+static PyTypeObject BatchType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "manager.Batch",
+  sizeof(BatchObject),
+  0,
+  /* Methods */
+  (destructor)batch_object_dealloc,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  Py_TPFLAGS_DEFAULT,
+  PyDoc_STR("Queues the edits of a Manager, and applies them at once.\n"
+            "You shouldn't create an instance of this class directly,\n"
+            "use `Manager.batch()'."),
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  batch_methods,
+  0,
+  batch_getset,
+};
+
+static PyObject* manager_batch(ManagerObject* self)
+{
+  BatchObject* batch = PyObject_New(BatchObject, &BatchType);
+  if (batch == NULL)
+  {
+    return NULL;
   }
 
-  // Wrong type of argument.
-  PyErr_Format(PyExc_TypeError,
-               "Expected a str, FileInfo or list. Found: %s",
-               Py_TYPE(argument)->tp_name);
-  return NULL;
+  Py_INCREF(self);
+  batch->manager = self;
+  batch->edit_batch = new libtocc_python::EditBatch();
+  batch->active = false;
+  batch->thread_id = 0;
+
+  return (PyObject*)batch;
 }
 
 /*
@@ -517,7 +4457,7 @@ static PyMethodDef manager_methods[] =
                  "  or there was something wrong with the path.")
     },
     {
-      "get_file_info", (PyCFunction)manager_get_file_info, METH_VARARGS,
+      "get_file_info", (PyCFunction)manager_get_file_info, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Gets information of a file.\n"
                 "\n"
                 "@param file_id: (str) ID of the file to get.\n"
@@ -527,7 +4467,22 @@ static PyMethodDef manager_methods[] =
                 "@throw DatabaseScriptLogicalError: if file not found.\n")
     },
     {
-      "get_file_by_traditional_path", (PyCFunction)manager_get_file_by_traditional_path, METH_VARARGS,
+      "get_file_infos", (PyCFunction)manager_get_file_infos, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Gets information of many files at once.\n"
+                "\n"
+                "@param file_ids: (collection of str) IDs of the files to get.\n"
+                "@keyword missing: (str or None) What to do if a file can't be\n"
+                "  found: \"raise\" (default) raises the error, \"skip\"\n"
+                "  leaves it out of the result, and None (or \"none\") puts\n"
+                "  None in its place.\n"
+                "\n"
+                "@return: list of FileInfo, in the order of the IDs.\n"
+                "\n"
+                "@throw DatabaseScriptLogicalError: if a file not found, and\n"
+                "  `missing' is \"raise\".")
+    },
+    {
+      "get_file_by_traditional_path", (PyCFunction)manager_get_file_by_traditional_path, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Gets information of the file, that its traditional_path matches\n"
                 "with the specified one.\n"
                 "\n"
@@ -538,14 +4493,26 @@ static PyMethodDef manager_methods[] =
                 "@throw DatabaseScriptLogicalError: if file not found.")
     },
     {
-      "import_file", (PyCFunction)manager_import_file, METH_VARARGS | METH_KEYWORDS,
+      "import_file", (PyCFunction)manager_import_file, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Imports a file from the path to the Tocc managed file system.\n"
                 "\n"
                 "@param source_path: (str) Path to the source file.\n"
                 "@keyword title: (str) title of the file.\n"
                 "@keyword traditional_path: (str) traditional path of the file.\n"
                 "  (Can be empty string.)\n"
-                "@keyword tags: (list of str) Tags to assign to the file.\n"
+                "@keyword tags: (collection of str) Tags to assign to the file.\n"
+                "@keyword import_mode: (str) How the data gets into the base path:\n"
+                "  \"copy\" (default) copies it. \"hardlink\" makes a hard link to\n"
+                "  the source (then changing one changes the other).\n"
+                "  \"reflink\" makes a copy-on-write clone, on file systems that\n"
+                "  support it. \"copy_file_range\" copies inside the kernel.\n"
+                "  \"move\" moves the source. If a mode isn't possible (e.g. the\n"
+                "  source is on another file system), data is copied instead.\n"
+                "@keyword dedup: (bool) If True, and a file with the same\n"
+                "  contents was imported with dedup before, the file isn't\n"
+                "  stored again: the tags are assigned to the existing file, and\n"
+                "  it's returned. (Title and traditional path are not changed.)\n"
+                "  Contents are hashed, and compared byte by byte on a match.\n"
                 "\n"
                 "@note: If you don't want to set title or traditional path,\n"
                 "  pass empty string (\"\"), not None.\n"
@@ -553,49 +4520,163 @@ static PyMethodDef manager_methods[] =
                 "@return: Information of the newly created file.")
     },
     {
-      "remove_file", (PyCFunction)manager_remove_file, METH_VARARGS,
+      "import_bytes", (PyCFunction)manager_import_bytes, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Imports a file from the data in memory. Data is written\n"
+                "directly to the base path, without a temporary file.\n"
+                "\n"
+                "@param data: (bytes-like) Any object that supports the buffer\n"
+                "  protocol, like bytes, bytearray, memoryview or mmap. It\n"
+                "  should be contiguous.\n"
+                "@keyword title: (str) title of the file.\n"
+                "@keyword traditional_path: (str) traditional path of the file.\n"
+                "@keyword tags: (collection of str) Tags to assign to the file.\n"
+                "\n"
+                "@return: Information of the newly created file.")
+    },
+    {
+      "import_fd", (PyCFunction)manager_import_fd, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Imports a file from the rest of a file descriptor (from its\n"
+                "current position to its end). It can be a pipe or a socket\n"
+                "as well. The descriptor isn't closed.\n"
+                "\n"
+                "@param fd: (int) The descriptor, or an object that has a\n"
+                "  fileno() method. Note that data a Python file object has\n"
+                "  already buffered is not imported.\n"
+                "@keyword title: (str) title of the file.\n"
+                "@keyword traditional_path: (str) traditional path of the file.\n"
+                "@keyword tags: (collection of str) Tags to assign to the file.\n"
+                "\n"
+                "@return: Information of the newly created file.")
+    },
+    {
+      "import_files", (PyCFunction)manager_import_files, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Imports many files in one call.\n"
+                "Failure of one file doesn't stop importing the others.\n"
+                "\n"
+                "@param records: An iterable of records. Each record is a tuple\n"
+                "  (source_path, title, traditional_path, tags) that its last\n"
+                "  items can be omitted, or a dict with the same keys.\n"
+                "@keyword ids_only: (bool) If True, returns IDs of the imported\n"
+                "  files instead of their FileInfos.\n"
+                "@keyword import_mode: (str) See `import_file'.\n"
+                "@keyword dedup: (bool) See `import_file'.\n"
+                "\n"
+                "@return: A tuple of (imported, failures). `imported' is a list\n"
+                "  of FileInfo (or str if ids_only) of the imported files, in\n"
+                "  order. `failures' is a list of (index, source_path, message)\n"
+                "  for the records that couldn't be imported.")
+    },
+    {
+      "import_directory", (PyCFunction)manager_import_directory, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Imports all of the files of a directory.\n"
+                "Directory is walked natively, and contents of the files\n"
+                "are transferred to the base path on a few threads, while\n"
+                "only their metadata is written one by one.\n"
+                "Failure of one file doesn't stop importing the others.\n"
+                "Symbolic links and special files are skipped.\n"
+                "\n"
+                "@param root: (str) Path of the directory.\n"
+                "@keyword recursive: (bool) If False, sub-directories are not\n"
+                "  imported. Default is True.\n"
+                "@keyword tags: (collection of str) Tags to assign to all of\n"
+                "  the files.\n"
+                "@keyword tags_from_path: (bool) If True, names of the\n"
+                "  directories between the root and each file are assigned\n"
+                "  to it as tags.\n"
+                "@keyword traditional_path_from: (str) \"absolute\" sets the\n"
+                "  absolute path of each file as its traditional path,\n"
+                "  \"relative\" sets its path relative to the root. Default\n"
+                "  is None (no traditional path).\n"
+                "@keyword workers: (int) Number of the threads that transfer\n"
+                "  contents of the files. With import_mode \"copy\", libtocc\n"
+                "  copies each file itself, so they only read the files\n"
+                "  ahead. 0 does all of it on the calling thread. Default\n"
+                "  depends on the number of CPUs.\n"
+                "@keyword progress: (callable) Called as\n"
+                "  progress(imported_count, failed_count) after every few\n"
+                "  files. If it raises an exception, importing stops and the\n"
+                "  exception is raised. Files that are imported are kept, and\n"
+                "  the report of them (same as the return value) is set as\n"
+                "  the `report' attribute of the exception. The same happens\n"
+                "  if importing is interrupted by a signal.\n"
+                "@keyword import_mode: (str) See `import_file'.\n"
+                "@keyword dedup: (bool) See `import_file'.\n"
+                "\n"
+                "@return: dict of `imported' (list of IDs of the imported\n"
+                "  files), `failures' (list of (path, message) for the files\n"
+                "  and directories that couldn't be imported) and `skipped'\n"
+                "  (number of the entries that aren't regular files).")
+    },
+    {
+      "remove_file", (PyCFunction)manager_remove_file, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Deletes the specified file, both from database and\n"
                 "file system.\n"
                 "\n"
                 "@param file_id: (str) ID of the file to delete.")
     },
     {
-      "remove_files", (PyCFunction)manager_remove_files, METH_VARARGS,
+      "remove_files", (PyCFunction)manager_remove_files, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Deletes a list of files, both from database and\n"
                 "file system.\n"
                 "\n"
-                "@param file_ids: (list of str) IDs of files to delete.")
+                "@param file_ids: (collection of str) IDs of files to delete.\n"
+                "  It can be a list, tuple, set or any iterable of str, or a\n"
+                "  bytes object or numpy `S' array of packed IDs.")
     },
     {
-      "assign_tags", (PyCFunction)manager_assign_tags, METH_VARARGS,
+      "assign_tags", (PyCFunction)manager_assign_tags, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Assign list of tags to a list of files.\n"
                 "It assigns all tags to each file.\n"
                 "\n"
-                "@param file_ids: (list of str) IDs of files to assign\n"
-                "  tags to.\n"
-                "@param tags: (list of str) Tags to assign.")
+                "@param file_ids: (collection of str) IDs of files to assign\n"
+                "  tags to. See `remove_files' for the accepted types.\n"
+                "@param tags: (collection of str) Tags to assign.")
     },
     {
-      "unassign_tags", (PyCFunction)manager_unassign_tags, METH_VARARGS,
+      "unassign_tags", (PyCFunction)manager_unassign_tags, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Unassign list of tags from a list of files.\n"
                 "It unassign each tags from all of the files.\n"
                 "Raises exception if specified files not found.\n"
                 "\n"
-                "@param file_ids: (list of str) IDs of files to unassign\n"
-                "  their tags.\n"
-                "@param tags: (list of str) Tags to unassign.")
+                "@param file_ids: (collection of str) IDs of files to unassign\n"
+                "  their tags. See `remove_files' for the accepted types.\n"
+                "@param tags: (collection of str) Tags to unassign.")
+    },
+    {
+      "apply_tag_changes", (PyCFunction)manager_apply_tag_changes, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Assigns and unassigns different tags of each file.\n"
+                "Files with the same changes are grouped, and all of the\n"
+                "changes are applied with a few bulk calls.\n"
+                "\n"
+                "@param changes: (dict) Maps file IDs to a\n"
+                "  (tags_to_add, tags_to_remove) tuple. Each of them is a\n"
+                "  collection of str, or None. If a tag is in both of them,\n"
+                "  it's unassigned.\n"
+                "\n"
+                "@note: Inside a `batch()', changes are queued like the\n"
+                "  other edits.")
     },
     {
-      "set_title", (PyCFunction)manager_set_title, METH_VARARGS,
+      "set_title", (PyCFunction)manager_set_title, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Sets title of a file.\n"
                 "\n"
-                "@param file_id: (str or list) ID of the file to set\n"
-                "  its title. It can be a single ID (str) or a list of\n"
-                "  IDs (list of str).\n"
+                "@param file_id: (str or collection) ID of the file to set\n"
+                "  its title. It can be a single ID (str) or a collection\n"
+                "  of IDs. See `remove_files' for the accepted types.\n"
                 "@param title: (str) Title to set to the file.")
     },
     {
-      "get_tags_statistics", (PyCFunction)manager_get_tags_statistics, METH_VARARGS | METH_KEYWORDS,
+      "set_titles", (PyCFunction)manager_set_titles, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Sets a different title for each file.\n"
+                "Files with the same title are changed by the same call.\n"
+                "\n"
+                "@param titles: (dict) Maps file IDs to their new titles.\n"
+                "\n"
+                "@note: Inside a `batch()', titles are queued like the\n"
+                "  other edits.")
+    },
+    {
+      "get_tags_statistics", (PyCFunction)manager_get_tags_statistics, METH_FASTCALL | METH_KEYWORDS,
       PyDoc_STR("Collects statistics (how many files assigned to each tag)\n"
                 "and returns it.\n"
                 "If no arguments passed, it returns statistics of all files.\n"
@@ -603,8 +4684,131 @@ static PyMethodDef manager_methods[] =
                 "files.\n"
                 "\n"
                 "@keyword files: Can be a File ID (str), a FileInfo instance,\n"
-                "  or a list of File IDs or FileInfos (or a list of mix of\n"
-                "  them.)")
+                "  or a collection of File IDs or FileInfos (or a mix of\n"
+                "  them.) See `remove_files' for the accepted collections.\n"
+                "@keyword limit: (int) Returns only this number of tags.\n"
+                "@keyword prefix: (str) Returns only tags that start with it.\n"
+                "@keyword sort: (str) \"count\" to sort most used tags first\n"
+                "  (default), or \"tag\" to sort alphabetically.\n"
+                "\n"
+                "@return: If none of limit, prefix or sort is passed, a dict\n"
+                "  of tag to number of its files. Otherwise, an ordered list\n"
+                "  of (tag, count) tuples.")
+    },
+    {
+      "complete_tags", (PyCFunction)manager_complete_tags, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Returns the tags that start with the specified prefix,\n"
+                "sorted alphabetically. Useful for auto-completing tags.\n"
+                "\n"
+                "Tags are looked up in memory, so the Manager should be\n"
+                "created with `track_tags' (see its limitations). The first\n"
+                "call reads all of the tags from the database, if they're\n"
+                "not read yet.\n"
+                "\n"
+                "@param prefix: (str) Beginning of the tags.\n"
+                "@keyword limit: (int) Maximum number of tags to return.\n"
+                "  Default is no limit.\n"
+                "\n"
+                "@return: list of str\n"
+                "\n"
+                "@throw RuntimeError: if `track_tags' isn't on.")
+    },
+    {
+      "search", (PyCFunction)manager_search, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Searches for files that match the specified query.\n"
+                "\n"
+                "@param query: A query expression (see `query' module), or\n"
+                "  a PreparedQuery. If the same query is searched many\n"
+                "  times, use a PreparedQuery, so it compiles only once.\n"
+                "@keyword limit: (int) Maximum number of files to return.\n"
+                "  Default (or None) is no limit.\n"
+                "@keyword offset: (int) Number of found files to skip.\n"
+                "\n"
+                "@return: A FileInfoIterator. It's also a cursor: call its\n"
+                "  `fetch(count)' to get the results page by page. It only\n"
+                "  lives in this process; to resume in a later call (e.g.\n"
+                "  the next page of a web client), pass its `position' as\n"
+                "  the `offset' of a new search.")
+    },
+    {
+      "count", (PyCFunction)manager_count, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Counts files that match the specified query.\n"
+                "\n"
+                "@param query: A query expression, or a PreparedQuery.\n"
+                "\n"
+                "@return: (int) Number of the found files.")
+    },
+    {
+      "search_ids", (PyCFunction)manager_search_ids, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Searches for files that match the specified query, and\n"
+                "returns only their IDs.\n"
+                "\n"
+                "@param query: A query expression, or a PreparedQuery.\n"
+                "\n"
+                "@return: tuple of str")
+    },
+    {
+      "get_file_info_async", (PyCFunction)manager_get_file_info_async, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Same as `get_file_info', but returns an asyncio future.\n"
+                "\n"
+                "The async methods should be called from a coroutine. They\n"
+                "run libtocc on a native worker pool with the GIL released,\n"
+                "and the future is completed on the calling loop. The\n"
+                "Manager is kept alive until the call finishes, and\n"
+                "cancelling the future doesn't stop the call.")
+    },
+    {
+      "import_file_async", (PyCFunction)manager_import_file_async, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Same as `import_file', but returns an asyncio future.\n"
+                "See `get_file_info_async'.")
+    },
+    {
+      "assign_tags_async", (PyCFunction)manager_assign_tags_async, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Same as `assign_tags', but returns an asyncio future.\n"
+                "See `get_file_info_async'.")
+    },
+    {
+      "search_async", (PyCFunction)manager_search_async, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Same as `search', but returns an asyncio future.\n"
+                "See `get_file_info_async'.")
+    },
+    {
+      "get_tags_statistics_async", (PyCFunction)manager_get_tags_statistics_async, METH_FASTCALL | METH_KEYWORDS,
+      PyDoc_STR("Same as `get_tags_statistics', but returns an asyncio\n"
+                "future. See `get_file_info_async'.")
+    },
+    {
+      "cache_info", (PyCFunction)manager_cache_info, METH_NOARGS,
+      PyDoc_STR("Returns statistics of the files cache.\n"
+                "\n"
+                "@return: dict of `hits', `misses', `evictions', `size' and\n"
+                "  `max_size'. All are zero if the cache is disabled.")
+    },
+    {
+      "cache_clear", (PyCFunction)manager_cache_clear, METH_NOARGS,
+      PyDoc_STR("Removes all of the files from the cache.")
+    },
+    {
+      "batch", (PyCFunction)manager_batch, METH_NOARGS,
+      PyDoc_STR("Returns a context manager that queues the edits.\n"
+                "Inside the `with' block, `assign_tags', `unassign_tags' and\n"
+                "`set_title' of this thread only queue the edits. Each\n"
+                "thread can have its own active batch. When the\n"
+                "block finishes, edits are merged (the last edit of each tag\n"
+                "or title of a file wins), files with the same edits are\n"
+                "grouped, and they're applied with a few bulk calls.\n"
+                "If the block raises an exception, queued edits are discarded.\n"
+                "\n"
+                "@note: Other methods, including `import_file', run\n"
+                "  immediately. They don't see the queued edits.\n"
+                "\n"
+                "@return: Batch. Its `queued', `coalesced' and `calls'\n"
+                "  attributes tell how many edits were merged.\n"
+                "\n"
+                "Example:\n"
+                "  with manager.batch() as batch:\n"
+                "    manager.assign_tags([file_id], [\"draft\"])\n"
+                "    manager.unassign_tags([file_id], [\"draft\"])")
     },
     { NULL, NULL}
 };
@@ -638,7 +4842,18 @@ static PyTypeObject ManagerType =
   PyDoc_STR("The front end of the Tocc.\n\n"
             "To create an instance, call: Manager(base_path)\n"
             "@param base_path: Base path of where tocc files kept.\n"
-            "  It should be an absolute path."),
+            "  It should be an absolute path.\n"
+            "@keyword cache_size: (int) Number of the recently used files\n"
+            "  to keep in memory. `get_file_info' and\n"
+            "  `get_file_by_traditional_path' return a cached file without\n"
+            "  querying the database. Changes made through this Manager\n"
+            "  update the cache, but changes made by other processes or\n"
+            "  Managers don't. Default is 0 (disabled).\n"
+            "@keyword track_tags: (bool) If True, number of files of each\n"
+            "  tag is kept in memory, and updated by the changes made\n"
+            "  through this Manager. Then `get_tags_statistics()' of all\n"
+            "  files doesn't query the database. Don't use it if other\n"
+            "  processes or Managers change the same base path."),
   0,
   0,
   0,
@@ -683,11 +4898,19 @@ PyMODINIT_FUNC PyInit_manager(void)
   PyObject* module = NULL;
 
   ManagerType.tp_new = PyType_GenericNew;
+#if PY_VERSION_HEX >= 0x03090000
+  ManagerType.tp_vectorcall = manager_vectorcall;
+#endif
   if (PyType_Ready(&ManagerType) < 0)
   {
     Py_XDECREF(module);
     return NULL;
   }
+  if (PyType_Ready(&BatchType) < 0)
+  {
+    Py_XDECREF(module);
+    return NULL;
+  }
 
   module = PyModule_Create(&manager_module);
   if (module == NULL)
@@ -697,6 +4920,7 @@ PyMODINIT_FUNC PyInit_manager(void)
   }
 
   PyModule_AddObject(module, "Manager", (PyObject*)&ManagerType);
+  PyModule_AddObject(module, "Batch", (PyObject*)&BatchType);
 
   // Importing C API of `file_info' module.
   if (import_file_info() < 0)
@@ -705,5 +4929,12 @@ PyMODINIT_FUNC PyInit_manager(void)
     return NULL;
   }
 
+  // Importing C API of `query' module.
+  if (import_query() < 0)
+  {
+    Py_XDECREF(module);
+    return NULL;
+  }
+
   return module;
 }
@@ -0,0 +1,724 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define QUERY_MODULE
+#include "query.h"
+#include "utilities.h"
+
+#include <libtocc/exprs/fields.h>
+#include <libtocc/exprs/functions.h>
+#include <libtocc/exprs/connectives.h>
+#include <libtocc/exprs/operations.h>
+#include <libtocc/common/base_exception.h>
+
+
+/*
+ * Kinds of query expressions.
+ */
+#define QUERY_EXPR_TAG 0
+#define QUERY_EXPR_TITLE 1
+#define QUERY_EXPR_WILDCARD 2
+#define QUERY_EXPR_AND 3
+#define QUERY_EXPR_OR 4
+#define QUERY_EXPR_NOT 5
+
+/*
+ * Names of the expression kinds, indexed by kind.
+ */
+static const char* query_expr_names[] =
+    { "Tag", "Title", "Wildcard", "And", "Or", "Not" };
+
+/*
+ * Defines a Python class, for query expressions.
+ * Expressions are immutable. They're kept as a tree of Python objects,
+ * and compiled to libtocc expressions only when a query is created.
+ */
+typedef struct
+{
+  PyObject_HEAD
+  int kind;
+  /*
+   * For Tag and Title, it's a str or a Wildcard expression.
+   * For Wildcard, it's a str.
+   * For others, it's NULL.
+   */
+  PyObject* value;
+  /*
+   * Tuple of sub-expressions of And, Or and Not. NULL for the others.
+   */
+  PyObject* operands;
+} QueryExprObject;
+
+/*
+ * Destructor.
+ */
+static void query_expr_object_dealloc(QueryExprObject* self)
+{
+  Py_XDECREF(self->value);
+  Py_XDECREF(self->operands);
+  PyObject_Del(self);
+}
+
+/*
+ * __repr__ method.
+ */
+static PyObject* query_expr_repr(QueryExprObject* self)
+{
+  const char* name = query_expr_names[self->kind];
+
+  if (self->value != NULL)
+  {
+    return PyUnicode_FromFormat("%s(%R)", name, self->value);
+  }
+
+  // Joining representation of the operands.
+  Py_ssize_t operands_size = PyTuple_GET_SIZE(self->operands);
+  PyObject* operands_reprs = PyList_New(operands_size);
+  if (operands_reprs == NULL)
+  {
+    return NULL;
+  }
+  libtocc_python::PyObjectHolder operands_reprs_holder(operands_reprs);
+
+  for (Py_ssize_t i = 0; i < operands_size; i++)
+  {
+    PyObject* operand_repr = PyObject_Repr(PyTuple_GET_ITEM(self->operands, i));
+    if (operand_repr == NULL)
+    {
+      return NULL;
+    }
+    PyList_SET_ITEM(operands_reprs, i, operand_repr);
+  }
+
+  PyObject* separator = PyUnicode_FromString(", ");
+  if (separator == NULL)
+  {
+    return NULL;
+  }
+  libtocc_python::PyObjectHolder separator_holder(separator);
+
+  PyObject* joined = PyUnicode_Join(separator, operands_reprs);
+  if (joined == NULL)
+  {
+    return NULL;
+  }
+  libtocc_python::PyObjectHolder joined_holder(joined);
+
+  return PyUnicode_FromFormat("%s(%U)", name, joined);
+}
+
+/*
+ * Definition of Type.
+ */
+static PyTypeObject QueryExprType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "query.Expr",
+  sizeof(QueryExprObject),
+  0,
+  /* Methods */
+  (destructor)query_expr_object_dealloc,
+  0,
+  0,
+  0,
+  0,
+  (reprfunc)query_expr_repr,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  Py_TPFLAGS_DEFAULT,
+  PyDoc_STR("A query expression.\n"
+            "You shouldn't create an instance of this class directly. Use\n"
+            "Tag, Title, Wildcard, And, Or and Not functions instead."),
+};
+
+/*
+ * Checks if the specified Python Object is a query expression.
+ */
+bool is_python_query_expr(PyObject* object)
+{
+  return (Py_TYPE(object) == &QueryExprType);
+}
+
+/*
+ * Creates a new expression object.
+ * It steals the references of `value' and `operands'.
+ */
+static PyObject* create_query_expr(int kind, PyObject* value, PyObject* operands)
+{
+  QueryExprObject* self = PyObject_New(QueryExprObject, &QueryExprType);
+  if (self == NULL)
+  {
+    Py_XDECREF(value);
+    Py_XDECREF(operands);
+    return NULL;
+  }
+
+  self->kind = kind;
+  self->value = value;
+  self->operands = operands;
+
+  return (PyObject*)self;
+}
+
+/*
+ * Creates a Tag or Title expression.
+ */
+static PyObject* create_field_expr(int kind, PyObject* const* args,
+                                   Py_ssize_t nargs, PyObject* kwnames)
+{
+  static const char* kwlist[] = { "value", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args(query_expr_names[kind], args, nargs,
+                                            kwnames, kwlist, 1, values))
+  {
+    return NULL;
+  }
+  PyObject* value = values[0];
+
+  if (!PyUnicode_Check(value) &&
+      !(is_python_query_expr(value) &&
+        ((QueryExprObject*)value)->kind == QUERY_EXPR_WILDCARD))
+  {
+    PyErr_Format(PyExc_TypeError,
+                 "%s accepts a str or a Wildcard. Found: %s",
+                 query_expr_names[kind], Py_TYPE(value)->tp_name);
+    return NULL;
+  }
+
+  Py_INCREF(value);
+  return create_query_expr(kind, value, NULL);
+}
+
+/*
+ * Creates an And, Or or Not expression.
+ */
+static PyObject* create_connective_expr(int kind, PyObject* const* args,
+                                        Py_ssize_t nargs)
+{
+  if (nargs <= 0)
+  {
+    PyErr_Format(PyExc_TypeError,
+                 "%s needs at least one expression.",
+                 query_expr_names[kind]);
+    return NULL;
+  }
+
+  for (Py_ssize_t i = 0; i < nargs; i++)
+  {
+    if (!is_python_query_expr(args[i]))
+    {
+      PyErr_Format(PyExc_TypeError,
+                   "%s accepts only query expressions. Found: %s",
+                   query_expr_names[kind], Py_TYPE(args[i])->tp_name);
+      return NULL;
+    }
+  }
+
+  PyObject* operands = PyTuple_New(nargs);
+  if (operands == NULL)
+  {
+    return NULL;
+  }
+  for (Py_ssize_t i = 0; i < nargs; i++)
+  {
+    Py_INCREF(args[i]);
+    PyTuple_SET_ITEM(operands, i, args[i]);
+  }
+
+  return create_query_expr(kind, NULL, operands);
+}
+
+static PyObject* query_tag(PyObject* module, PyObject* const* args,
+                           Py_ssize_t nargs, PyObject* kwnames)
+{
+  return create_field_expr(QUERY_EXPR_TAG, args, nargs, kwnames);
+}
+
+static PyObject* query_title(PyObject* module, PyObject* const* args,
+                             Py_ssize_t nargs, PyObject* kwnames)
+{
+  return create_field_expr(QUERY_EXPR_TITLE, args, nargs, kwnames);
+}
+
+static PyObject* query_wildcard(PyObject* module, PyObject* const* args,
+                                Py_ssize_t nargs, PyObject* kwnames)
+{
+  static const char* kwlist[] = { "pattern", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("Wildcard", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+  PyObject* pattern = values[0];
+
+  if (!PyUnicode_Check(pattern))
+  {
+    PyErr_Format(PyExc_TypeError,
+                 "Wildcard accepts a str. Found: %s",
+                 Py_TYPE(pattern)->tp_name);
+    return NULL;
+  }
+
+  Py_INCREF(pattern);
+  return create_query_expr(QUERY_EXPR_WILDCARD, pattern, NULL);
+}
+
+static PyObject* query_and(PyObject* module, PyObject* const* args,
+                           Py_ssize_t nargs)
+{
+  return create_connective_expr(QUERY_EXPR_AND, args, nargs);
+}
+
+static PyObject* query_or(PyObject* module, PyObject* const* args,
+                          Py_ssize_t nargs)
+{
+  return create_connective_expr(QUERY_EXPR_OR, args, nargs);
+}
+
+static PyObject* query_not(PyObject* module, PyObject* const* args,
+                           Py_ssize_t nargs, PyObject* kwnames)
+{
+  static const char* kwlist[] = { "expr", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_fastcall_args("Not", args, nargs, kwnames,
+                                            kwlist, 1, values))
+  {
+    return NULL;
+  }
+
+  return create_connective_expr(QUERY_EXPR_NOT, values, 1);
+}
+
+/*
+ * Compiles the specified expression to a libtocc expression.
+ *
+ * Note that you should delete the return pointer when you finished with it.
+ *
+ * @return: NULL if any errors happen. It sets the Python Error.
+ */
+static libtocc::Expr* compile_expr(QueryExprObject* expr)
+{
+  switch (expr->kind)
+  {
+    case QUERY_EXPR_TAG:
+    case QUERY_EXPR_TITLE:
+    {
+      if (PyUnicode_Check(expr->value))
+      {
+        const char* value = libtocc_python::python_unicode_to_char(expr->value);
+        if (value == NULL)
+        {
+          return NULL;
+        }
+        if (expr->kind == QUERY_EXPR_TAG)
+        {
+          return new libtocc::Tag(value);
+        }
+        return new libtocc::Title(value);
+      }
+
+      // Value is a Wildcard.
+      const char* pattern = libtocc_python::python_unicode_to_char(
+          ((QueryExprObject*)expr->value)->value);
+      if (pattern == NULL)
+      {
+        return NULL;
+      }
+      libtocc::Wildcard wildcard(pattern);
+      if (expr->kind == QUERY_EXPR_TAG)
+      {
+        return new libtocc::Tag(wildcard);
+      }
+      return new libtocc::Title(wildcard);
+    }
+
+    case QUERY_EXPR_WILDCARD:
+    {
+      PyErr_SetString(PyExc_ValueError,
+                      "Wildcard should be used inside a Tag or a Title.");
+      return NULL;
+    }
+
+    case QUERY_EXPR_NOT:
+    {
+      libtocc::Expr* operand =
+          compile_expr((QueryExprObject*)PyTuple_GET_ITEM(expr->operands, 0));
+      if (operand == NULL)
+      {
+        return NULL;
+      }
+
+      // libtocc expressions keep a copy of their operands.
+      libtocc::Expr* result = new libtocc::Not(*operand);
+      delete operand;
+      return result;
+    }
+
+    default:
+    {
+      // And, Or.
+      libtocc::Expr* operand =
+          compile_expr((QueryExprObject*)PyTuple_GET_ITEM(expr->operands, 0));
+      if (operand == NULL)
+      {
+        return NULL;
+      }
+
+      libtocc::ConnectiveExpr* result;
+      if (expr->kind == QUERY_EXPR_AND)
+      {
+        result = new libtocc::And(*operand);
+      }
+      else
+      {
+        result = new libtocc::Or(*operand);
+      }
+      delete operand;
+
+      for (Py_ssize_t i = 1; i < PyTuple_GET_SIZE(expr->operands); i++)
+      {
+        operand =
+            compile_expr((QueryExprObject*)PyTuple_GET_ITEM(expr->operands, i));
+        if (operand == NULL)
+        {
+          delete result;
+          return NULL;
+        }
+        result->add(*operand);
+        delete operand;
+      }
+
+      return result;
+    }
+  }
+}
+
+/*
+ * Compiles the specified query expression to a libtocc::Query.
+ */
+libtocc::Query* compile_python_query(PyObject* expr)
+{
+  if (!is_python_query_expr(expr))
+  {
+    PyErr_Format(PyExc_TypeError,
+                 "Expected a query expression. Found: %s",
+                 Py_TYPE(expr)->tp_name);
+    return NULL;
+  }
+
+  try
+  {
+    libtocc::Expr* compiled_expr = compile_expr((QueryExprObject*)expr);
+    if (compiled_expr == NULL)
+    {
+      return NULL;
+    }
+
+    libtocc::Query* result = new libtocc::Query(*compiled_expr);
+    delete compiled_expr;
+
+    return result;
+  }
+  catch (libtocc::BaseException& error)
+  {
+    libtocc_python::set_libtocc_error(error);
+    return NULL;
+  }
+}
+
+/*
+ * Defines a Python class, for a compiled query.
+ */
+typedef struct
+{
+  PyObject_HEAD
+  libtocc::Query* query_instance;
+  // The expression this query is compiled from.
+  PyObject* expr;
+} PreparedQueryObject;
+
+/*
+ * __init__ method.
+ */
+static int prepared_query_init(PreparedQueryObject* self, PyObject* args, PyObject* kwargs)
+{
+  static const char* kwlist[] = { "expr", NULL };
+  PyObject* values[1];
+
+  if (!libtocc_python::unpack_tuple_args("PreparedQuery", args, kwargs,
+                                         kwlist, 1, values))
+  {
+    return -1;
+  }
+
+  // Managers use the compiled query while the GIL is released, so it
+  // can't be replaced once it's created.
+  if (self->query_instance != NULL)
+  {
+    PyErr_SetString(PyExc_TypeError, "PreparedQuery is already initialized.");
+    return -1;
+  }
+
+  libtocc::Query* query = compile_python_query(values[0]);
+  if (query == NULL)
+  {
+    return -1;
+  }
+
+  self->query_instance = query;
+  Py_INCREF(values[0]);
+  Py_XSETREF(self->expr, values[0]);
+
+  return 0;
+}
+
+/*
+ * Destructor.
+ */
+static void prepared_query_object_dealloc(PreparedQueryObject* self)
+{
+  if (self->query_instance != NULL)
+  {
+    delete self->query_instance;
+    self->query_instance = NULL;
+  }
+  Py_XDECREF(self->expr);
+  PyObject_Del(self);
+}
+
+/*
+ * __repr__ method.
+ */
+static PyObject* prepared_query_repr(PreparedQueryObject* self)
+{
+  if (self->expr == NULL)
+  {
+    return PyUnicode_FromString("PreparedQuery()");
+  }
+  return PyUnicode_FromFormat("PreparedQuery(%R)", self->expr);
+}
+
+/*
+ * Definition of Type.
+ */
+static PyTypeObject PreparedQueryType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "query.PreparedQuery",
+  sizeof(PreparedQueryObject),
+  0,
+  /* Methods */
+  (destructor)prepared_query_object_dealloc,
+  0,
+  0,
+  0,
+  0,
+  (reprfunc)prepared_query_repr,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  Py_TPFLAGS_DEFAULT,
+  PyDoc_STR("A query that is compiled once, and can be searched many times.\n\n"
+            "To create an instance, call: PreparedQuery(expr)\n"
+            "It can't be re-initialized afterwards.\n"
+            "@param expr: A query expression."),
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  (initproc)prepared_query_init,
+};
+
+/*
+ * Checks if the specified Python Object is a PreparedQuery.
+ */
+bool is_python_prepared_query(PyObject* object)
+{
+  return (Py_TYPE(object) == &PreparedQueryType);
+}
+
+/*
+ * Returns the internal pointer for the specified PreparedQuery.
+ */
+libtocc::Query* python_prepared_query_get(PyObject* prepared_query)
+{
+  if (!is_python_prepared_query(prepared_query))
+  {
+    PyErr_SetString(PyExc_TypeError,
+        "Specified object is not a PreparedQuery.");
+    return NULL;
+  }
+
+  libtocc::Query* result = ((PreparedQueryObject*)prepared_query)->query_instance;
+  if (result == NULL)
+  {
+    PyErr_SetString(PyExc_ValueError, "PreparedQuery is not initialized.");
+  }
+  return result;
+}
+
+/*
+ * Functions of the module.
+ */
+static PyMethodDef query_functions[] =
+{
+  {
+    "Tag", (PyCFunction)query_tag, METH_FASTCALL | METH_KEYWORDS,
+    PyDoc_STR("Matches files that have the specified tag.\n"
+              "\n"
+              "@param value: (str or Wildcard) Tag to match.\n"
+              "\n"
+              "@return: Expr")
+  },
+  {
+    "Title", (PyCFunction)query_title, METH_FASTCALL | METH_KEYWORDS,
+    PyDoc_STR("Matches files that have the specified title.\n"
+              "\n"
+              "@param value: (str or Wildcard) Title to match.\n"
+              "\n"
+              "@return: Expr")
+  },
+  {
+    "Wildcard", (PyCFunction)query_wildcard, METH_FASTCALL | METH_KEYWORDS,
+    PyDoc_STR("A wildcard pattern, to use inside a Tag or a Title.\n"
+              "\n"
+              "@param pattern: (str) Pattern to match.\n"
+              "\n"
+              "@return: Expr")
+  },
+  {
+    "And", (PyCFunction)query_and, METH_FASTCALL,
+    PyDoc_STR("Matches files that match all of the specified expressions.\n"
+              "\n"
+              "@param exprs: One or more expressions.\n"
+              "\n"
+              "@return: Expr")
+  },
+  {
+    "Or", (PyCFunction)query_or, METH_FASTCALL,
+    PyDoc_STR("Matches files that match any of the specified expressions.\n"
+              "\n"
+              "@param exprs: One or more expressions.\n"
+              "\n"
+              "@return: Expr")
+  },
+  {
+    "Not", (PyCFunction)query_not, METH_FASTCALL | METH_KEYWORDS,
+    PyDoc_STR("Matches files that don't match the specified expression.\n"
+              "\n"
+              "@param expr: An expression.\n"
+              "\n"
+              "@return: Expr")
+  },
+  {NULL, NULL}
+};
+
+/*
+ * Definitions of Module.
+ */
+PyDoc_STRVAR(module_doc,
+  "Defines query expressions, and PreparedQuery class.");
+
+static struct PyModuleDef query_module = {
+    PyModuleDef_HEAD_INIT,
+    "query",
+    module_doc,
+    -1,
+    query_functions,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+/*
+ * Module initialization func.
+ */
+extern "C"
+PyMODINIT_FUNC PyInit_query(void)
+{
+  PyObject* module = NULL;
+  static void* QueryAPI[QUERY_API_POINTERS];
+  PyObject* c_api_object;
+
+  // Creating module.
+  if (PyType_Ready(&QueryExprType) < 0)
+  {
+    return NULL;
+  }
+  PreparedQueryType.tp_new = PyType_GenericNew;
+  if (PyType_Ready(&PreparedQueryType) < 0)
+  {
+    return NULL;
+  }
+
+  module = PyModule_Create(&query_module);
+  if (module == NULL)
+  {
+    return NULL;
+  }
+
+  PyModule_AddObject(module, "Expr", (PyObject*)&QueryExprType);
+  PyModule_AddObject(module, "PreparedQuery", (PyObject*)&PreparedQueryType);
+
+  // Creating C API and adding it to module.
+
+  // API funcs.
+  QueryAPI[QUERY_IS_EXPR_NUM] = (void*)is_python_query_expr;
+  QueryAPI[QUERY_IS_PREPARED_NUM] = (void*)is_python_prepared_query;
+  QueryAPI[QUERY_COMPILE_NUM] = (void*)compile_python_query;
+  QueryAPI[QUERY_PREPARED_GET_NUM] = (void*)python_prepared_query_get;
+
+  // Capsule object.
+  c_api_object = PyCapsule_New((void*)QueryAPI, "query._C_API", NULL);
+  if (c_api_object != NULL)
+  {
+    PyModule_AddObject(module, "_C_API", c_api_object);
+  }
+
+  return module;
+}
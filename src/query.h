@@ -0,0 +1,107 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_QUERY_H_INCLUDED
+#define LIBTOCC_PYTHON_QUERY_H_INCLUDED
+
+/*
+ * Header file for `query' module.
+ */
+
+extern "C"
+{
+#include "Python.h"
+}
+
+#include <libtocc/exprs/query.h>
+
+
+#define QUERY_IS_EXPR_NUM 0
+#define QUERY_IS_PREPARED_NUM 1
+#define QUERY_COMPILE_NUM 2
+#define QUERY_PREPARED_GET_NUM 3
+#define QUERY_API_POINTERS 4
+
+
+#ifdef QUERY_MODULE
+
+// This section is used when compiling query.cpp
+bool is_python_query_expr(PyObject* object);
+bool is_python_prepared_query(PyObject* object);
+libtocc::Query* compile_python_query(PyObject* expr);
+libtocc::Query* python_prepared_query_get(PyObject* prepared_query);
+
+#else
+
+// This section is used when someone else uses this module's API.
+extern "C"
+{
+static void** QueryAPI;
+}
+
+/*
+ * Checks if the specified Python Object is a query expression.
+ */
+#define is_python_query_expr \
+  (*(bool (*)(PyObject* object)) QueryAPI[QUERY_IS_EXPR_NUM])
+
+/*
+ * Checks if the specified Python Object is a PreparedQuery.
+ */
+#define is_python_prepared_query \
+  (*(bool (*)(PyObject* object)) QueryAPI[QUERY_IS_PREPARED_NUM])
+
+/*
+ * Compiles the specified query expression to a libtocc::Query.
+ *
+ * Note that you should delete the return pointer when you finished with it.
+ *
+ * @return: NULL if any errors happen.
+ *   It sets the Python Error if error happen.
+ */
+#define compile_python_query \
+  (*(libtocc::Query* (*)(PyObject* expr)) QueryAPI[QUERY_COMPILE_NUM])
+
+/*
+ * Returns the internal pointer for the specified PreparedQuery.
+ * The pointer points to the libtocc::Query kept inside the PyObject.
+ */
+#define python_prepared_query_get \
+  (*(libtocc::Query* (*)(PyObject* prepared_query)) QueryAPI[QUERY_PREPARED_GET_NUM])
+
+extern "C"
+{
+/*
+ * Returns 0 on success, -1 on error.
+ * It will set an exception if there was error.
+ */
+static int import_query(void)
+{
+  QueryAPI = (void**)PyCapsule_Import("query._C_API", 0);
+  if (QueryAPI == NULL)
+  {
+    return -1;
+  }
+  return 0;
+}
+}
+
+#endif /* QUERY_MODULE */
+
+#endif /* LIBTOCC_PYTHON_QUERY_H_INCLUDED */
@@ -0,0 +1,197 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tags_table.h"
+
+#include <set>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Returns the distinct tags of the collection. Each tag should change
+   * the counts once, even if it's repeated.
+   */
+  static std::set<std::string> distinct_tags(libtocc::TagsCollection& tags)
+  {
+    std::set<std::string> result;
+    libtocc::TagsCollection::Iterator iterator(&tags);
+    for (; !iterator.is_finished(); iterator.next())
+    {
+      result.insert(iterator.get());
+    }
+    return result;
+  }
+
+  TagsTable::TagsTable()
+  {
+    this->seeded = false;
+  }
+
+  bool TagsTable::is_seeded()
+  {
+    return this->seeded;
+  }
+
+  void TagsTable::seed(libtocc::TagStatisticsCollection& statistics)
+  {
+    this->counts.clear();
+
+    libtocc::TagStatisticsCollection::Iterator iterator(&statistics);
+    for (; !iterator.is_finished(); iterator.next())
+    {
+      libtocc::TagStatistics item = iterator.get();
+      if (item.get_assigned_files() > 0)
+      {
+        this->counts[item.get_tag()] = item.get_assigned_files();
+      }
+    }
+
+    this->seeded = true;
+  }
+
+  void TagsTable::unseed()
+  {
+    this->counts.clear();
+    this->seeded = false;
+  }
+
+  void TagsTable::assigned(libtocc::TagStatisticsCollection& before,
+                           libtocc::TagsCollection& tags,
+                           unsigned int files_count)
+  {
+    std::set<std::string> assigned_tags = distinct_tags(tags);
+
+    // After assign, all of the files have each tag.
+    std::set<std::string>::iterator tags_iterator = assigned_tags.begin();
+    for (; tags_iterator != assigned_tags.end(); ++tags_iterator)
+    {
+      add(tags_iterator->c_str(), files_count);
+    }
+
+    // Except the ones that had it before.
+    libtocc::TagStatisticsCollection::Iterator iterator(&before);
+    for (; !iterator.is_finished(); iterator.next())
+    {
+      libtocc::TagStatistics item = iterator.get();
+      if (assigned_tags.count(item.get_tag()) > 0)
+      {
+        add(item.get_tag(), -(long)item.get_assigned_files());
+      }
+    }
+  }
+
+  void TagsTable::unassigned(libtocc::TagStatisticsCollection& before,
+                             libtocc::TagsCollection& tags)
+  {
+    std::set<std::string> unassigned_tags = distinct_tags(tags);
+
+    libtocc::TagStatisticsCollection::Iterator iterator(&before);
+    for (; !iterator.is_finished(); iterator.next())
+    {
+      libtocc::TagStatistics item = iterator.get();
+      if (unassigned_tags.count(item.get_tag()) > 0)
+      {
+        add(item.get_tag(), -(long)item.get_assigned_files());
+      }
+    }
+  }
+
+  void TagsTable::removed(libtocc::TagStatisticsCollection& before)
+  {
+    libtocc::TagStatisticsCollection::Iterator iterator(&before);
+    for (; !iterator.is_finished(); iterator.next())
+    {
+      libtocc::TagStatistics item = iterator.get();
+      add(item.get_tag(), -(long)item.get_assigned_files());
+    }
+  }
+
+  void TagsTable::imported(libtocc::FileInfo& file_info)
+  {
+    libtocc::TagsCollection tags = file_info.get_tags();
+    std::set<std::string> imported_tags = distinct_tags(tags);
+    std::set<std::string>::iterator iterator = imported_tags.begin();
+    for (; iterator != imported_tags.end(); ++iterator)
+    {
+      add(iterator->c_str(), 1);
+    }
+  }
+
+  const TagsTable::CountsMap& TagsTable::get_counts()
+  {
+    return this->counts;
+  }
+
+  void TagsTable::add(const char* tag, long delta)
+  {
+    CountsMap::iterator found = this->counts.find(tag);
+    long count = delta;
+    if (found != this->counts.end())
+    {
+      count += found->second;
+    }
+
+    if (count > 0)
+    {
+      if (found != this->counts.end())
+      {
+        found->second = count;
+      }
+      else
+      {
+        this->counts.insert(found, CountsMap::value_type(tag, count));
+      }
+    }
+    else if (found != this->counts.end())
+    {
+      // Tags without any files are not reported by libtocc either.
+      this->counts.erase(found);
+    }
+  }
+
+  TagsTableGuard::TagsTableGuard(TagsTable* table)
+  {
+    this->table = table;
+  }
+
+  TagsTableGuard::~TagsTableGuard()
+  {
+    if (this->table != NULL)
+    {
+      this->table->unseed();
+    }
+  }
+
+  TagsTable* TagsTableGuard::get()
+  {
+    if (this->table == NULL || !this->table->is_seeded())
+    {
+      return NULL;
+    }
+    return this->table;
+  }
+
+  void TagsTableGuard::commit()
+  {
+    this->table = NULL;
+  }
+
+}
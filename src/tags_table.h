@@ -0,0 +1,139 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_TAGS_TABLE_H_INCLUDED
+#define LIBTOCC_PYTHON_TAGS_TABLE_H_INCLUDED
+
+#include <libtocc/front_end/file_info.h>
+#include <libtocc/front_end/tags_collection.h>
+#include <libtocc/front_end/tag_statistics.h>
+
+#include <map>
+#include <string>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * Keeps number of the files assigned to each tag, so statistics of all
+   * of the files can be returned without querying the database.
+   *
+   * It's seeded once from libtocc, and then updated after each change.
+   * If a change fails half way, the table is unseeded, and it will be
+   * seeded again on the next use.
+   *
+   * It doesn't hold any Python objects. It should be used while the
+   * Manager's lock is held, in the same lock section as the libtocc call
+   * that it reflects, so the table always matches the database.
+   */
+  class TagsTable
+  {
+  public:
+    typedef std::map<std::string, unsigned int> CountsMap;
+
+    TagsTable();
+
+    bool is_seeded();
+
+    /*
+     * Fills the table with the statistics of all of the files.
+     */
+    void seed(libtocc::TagStatisticsCollection& statistics);
+
+    /*
+     * Clears the table. It should be seeded again before use.
+     */
+    void unseed();
+
+    /*
+     * Updates the table after the specified tags are assigned to
+     * some files.
+     *
+     * @param before: Statistics of the files, before the assign.
+     * @param tags: Tags that are assigned.
+     * @param files_count: Number of the (distinct) files.
+     */
+    void assigned(libtocc::TagStatisticsCollection& before,
+                  libtocc::TagsCollection& tags,
+                  unsigned int files_count);
+
+    /*
+     * Updates the table after the specified tags are unassigned from
+     * some files.
+     *
+     * @param before: Statistics of the files, before the unassign.
+     */
+    void unassigned(libtocc::TagStatisticsCollection& before,
+                    libtocc::TagsCollection& tags);
+
+    /*
+     * Updates the table after some files are removed.
+     *
+     * @param before: Statistics of the files, before they're removed.
+     */
+    void removed(libtocc::TagStatisticsCollection& before);
+
+    /*
+     * Updates the table after a file is imported.
+     */
+    void imported(libtocc::FileInfo& file_info);
+
+    /*
+     * Returns the counts, sorted by tag.
+     */
+    const CountsMap& get_counts();
+
+  private:
+    void add(const char* tag, long delta);
+
+    CountsMap counts;
+    bool seeded;
+  };
+
+  /*
+   * Unseeds the table at destruction time, unless `commit' is called.
+   * Declare it after the GILReleaser, so if libtocc throws, the table
+   * is unseeded before the lock is released.
+   */
+  class TagsTableGuard
+  {
+  public:
+    /*
+     * @param table: Can be NULL, then it does nothing.
+     */
+    TagsTableGuard(TagsTable* table);
+
+    ~TagsTableGuard();
+
+    /*
+     * Returns the table if it's seeded, so it needs to be updated.
+     * Otherwise returns NULL.
+     */
+    TagsTable* get();
+
+    void commit();
+
+  private:
+    TagsTable* table;
+  };
+
+}
+
+#endif /* LIBTOCC_PYTHON_TAGS_TABLE_H_INCLUDED */
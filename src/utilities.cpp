@@ -19,6 +19,11 @@
 
 #include "utilities.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+
 
 namespace libtocc_python
 {
@@ -39,37 +44,543 @@ namespace libtocc_python
     Py_XDECREF(this->object);
   }
 
-  char* python_unicode_to_char(PyObject* unicode_object)
+  GILReleaser::GILReleaser(PyThread_type_lock lock)
   {
-    PyObject* bytes_object =
-        PyUnicode_AsEncodedString(unicode_object,
-                                  "utf-8",
-                                  "Could not encode the Unicode into UTF-8");
-    if (bytes_object == NULL)
+    this->lock = lock;
+    this->thread_state = PyEval_SaveThread();
+
+    if (this->lock != NULL)
     {
-      return NULL;
+      PyThread_acquire_lock(this->lock, WAIT_LOCK);
     }
+  }
 
-    libtocc_python::PyObjectHolder bytes_holder(bytes_object);
+  GILReleaser::~GILReleaser()
+  {
+    restore();
+  }
 
-    char* result = PyBytes_AsString(bytes_object);
+  void GILReleaser::restore()
+  {
+    if (this->thread_state == NULL)
+    {
+      // Already restored.
+      return;
+    }
+
+    if (this->lock != NULL)
+    {
+      PyThread_release_lock(this->lock);
+      this->lock = NULL;
+    }
+
+    PyEval_RestoreThread(this->thread_state);
+    this->thread_state = NULL;
+  }
+
+  LockHolder::LockHolder(PyThread_type_lock lock)
+  {
+    this->lock = lock;
+    if (this->lock != NULL)
+    {
+      PyThread_acquire_lock(this->lock, WAIT_LOCK);
+    }
+  }
+
+  LockHolder::~LockHolder()
+  {
+    if (this->lock != NULL)
+    {
+      PyThread_release_lock(this->lock);
+    }
+  }
+
+  void set_libtocc_error(libtocc::BaseException& error)
+  {
+    PyErr_SetString(PyExc_RuntimeError, error.what());
+  }
+
+  /*
+   * Default size of the arena blocks.
+   */
+  static const size_t ARENA_BLOCK_SIZE = 16 * 1024;
+
+  StringArena::StringArena()
+  {
+    this->current_block = NULL;
+  }
+
+  StringArena::~StringArena()
+  {
+    while (this->current_block != NULL)
+    {
+      Block* previous = this->current_block->previous;
+      free(this->current_block);
+      this->current_block = previous;
+    }
+  }
+
+  void StringArena::reserve(size_t size)
+  {
+    // Leaving room for aligning the next allocation.
+    size += sizeof(void*);
+
+    if (this->current_block != NULL &&
+        this->current_block->capacity - this->current_block->used >= size)
+    {
+      return;
+    }
+
+    size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+    // Data of the block is right after its header.
+    Block* block = (Block*)malloc(sizeof(Block) + capacity);
+    if (block == NULL)
+    {
+      throw std::bad_alloc();
+    }
+    block->previous = this->current_block;
+    block->capacity = capacity;
+    block->used = 0;
+
+    this->current_block = block;
+  }
+
+  void* StringArena::allocate(size_t size)
+  {
+    // Reserve leaves enough room for the alignment.
+    reserve(size);
+
+    // Aligning for pointers.
+    Block* block = this->current_block;
+    block->used = (block->used + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    char* result = (char*)(block + 1) + block->used;
+    block->used += size;
 
-    // `result' will be NULL, if any error happen.
     return result;
   }
 
+  const char* StringArena::copy(const char* str, size_t size)
+  {
+    reserve(size + 1);
+
+    // Strings don't need to be aligned.
+    Block* block = this->current_block;
+    char* result = (char*)(block + 1) + block->used;
+    block->used += size + 1;
+
+    memcpy(result, str, size);
+    result[size] = '\0';
+
+    return result;
+  }
+
+  const char* python_unicode_to_char(PyObject* unicode_object)
+  {
+    Py_ssize_t size;
+    return python_unicode_to_char(unicode_object, &size);
+  }
+
+  const char* python_unicode_to_char(PyObject* unicode_object,
+                                     Py_ssize_t* size)
+  {
+    if (!PyUnicode_Check(unicode_object))
+    {
+      PyErr_Format(PyExc_TypeError,
+                   "Expected a str. Found: %s",
+                   Py_TYPE(unicode_object)->tp_name);
+      return NULL;
+    }
+
+    // `result' will be NULL, if any error happen.
+    return PyUnicode_AsUTF8AndSize(unicode_object, size);
+  }
+
+  /*
+   * Sets value of the keyword argument `name' in `out_values'.
+   */
+  static bool set_keyword_arg(const char* function_name,
+                              PyObject* name, PyObject* value,
+                              const char* const* kwlist,
+                              PyObject** out_values)
+  {
+    int parameter_index = 0;
+    if (PyUnicode_Check(name))
+    {
+      while (kwlist[parameter_index] != NULL &&
+             PyUnicode_CompareWithASCIIString(name, kwlist[parameter_index]) != 0)
+      {
+        parameter_index++;
+      }
+    }
+    else
+    {
+      while (kwlist[parameter_index] != NULL)
+      {
+        parameter_index++;
+      }
+    }
+
+    if (kwlist[parameter_index] == NULL)
+    {
+      PyErr_Format(PyExc_TypeError,
+                   "%s() got an unexpected keyword argument '%S'",
+                   function_name, name);
+      return false;
+    }
+    if (out_values[parameter_index] != NULL)
+    {
+      PyErr_Format(PyExc_TypeError,
+                   "%s() got multiple values for argument '%s'",
+                   function_name, kwlist[parameter_index]);
+      return false;
+    }
+
+    out_values[parameter_index] = value;
+    return true;
+  }
+
+  /*
+   * Sets the positional arguments in `out_values', and clears the rest.
+   */
+  static bool set_positional_args(const char* function_name,
+                                  PyObject* const* args, Py_ssize_t nargs,
+                                  const char* const* kwlist,
+                                  PyObject** out_values)
+  {
+    int parameters_size = 0;
+    while (kwlist[parameters_size] != NULL)
+    {
+      out_values[parameters_size] = NULL;
+      parameters_size++;
+    }
+
+    if (nargs > parameters_size)
+    {
+      PyErr_Format(PyExc_TypeError,
+                   "%s() takes at most %d arguments (%zd given)",
+                   function_name, parameters_size, nargs);
+      return false;
+    }
+
+    for (Py_ssize_t i = 0; i < nargs; i++)
+    {
+      out_values[i] = args[i];
+    }
+
+    return true;
+  }
+
+  /*
+   * Checks that all of the required arguments are set.
+   */
+  static bool check_required_args(const char* function_name,
+                                  const char* const* kwlist, int required,
+                                  PyObject** out_values)
+  {
+    for (int i = 0; i < required; i++)
+    {
+      if (out_values[i] == NULL)
+      {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() missing required argument '%s'",
+                     function_name, kwlist[i]);
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool unpack_fastcall_args(const char* function_name,
+                            PyObject* const* args, Py_ssize_t nargs,
+                            PyObject* kwnames,
+                            const char* const* kwlist, int required,
+                            PyObject** out_values)
+  {
+    if (!set_positional_args(function_name, args, nargs, kwlist, out_values))
+    {
+      return false;
+    }
+
+    if (kwnames != NULL)
+    {
+      Py_ssize_t kwargs_size = PyTuple_GET_SIZE(kwnames);
+      for (Py_ssize_t i = 0; i < kwargs_size; i++)
+      {
+        if (!set_keyword_arg(function_name, PyTuple_GET_ITEM(kwnames, i),
+                             args[nargs + i], kwlist, out_values))
+        {
+          return false;
+        }
+      }
+    }
+
+    return check_required_args(function_name, kwlist, required, out_values);
+  }
+
+  bool unpack_tuple_args(const char* function_name,
+                         PyObject* args, PyObject* kwargs,
+                         const char* const* kwlist, int required,
+                         PyObject** out_values)
+  {
+    if (!set_positional_args(function_name, PySequence_Fast_ITEMS(args),
+                             PyTuple_GET_SIZE(args), kwlist, out_values))
+    {
+      return false;
+    }
+
+    if (kwargs != NULL)
+    {
+      Py_ssize_t position = 0;
+      PyObject* name;
+      PyObject* value;
+      while (PyDict_Next(kwargs, &position, &name, &value))
+      {
+        if (!set_keyword_arg(function_name, name, value, kwlist, out_values))
+        {
+          return false;
+        }
+      }
+    }
+
+    return check_required_args(function_name, kwlist, required, out_values);
+  }
+
+  bool python_to_ssize_t(PyObject* object, Py_ssize_t* out_value)
+  {
+    Py_ssize_t value = PyNumber_AsSsize_t(object, PyExc_OverflowError);
+    if (value == -1 && PyErr_Occurred())
+    {
+      return false;
+    }
+
+    *out_value = value;
+    return true;
+  }
+
+  StringsVisitor::~StringsVisitor()
+  {
+  }
+
+  bool StringsVisitor::visit_object(PyObject* item)
+  {
+    PyErr_Format(PyExc_TypeError,
+                 "Expected a str. Found: %s",
+                 Py_TYPE(item)->tp_name);
+    return false;
+  }
+
+  /*
+   * Passes a single item to the visitor.
+   */
+  static bool visit_item(PyObject* item, StringsVisitor& visitor)
+  {
+    if (!PyUnicode_Check(item))
+    {
+      return visitor.visit_object(item);
+    }
+
+    Py_ssize_t size;
+    const char* str = python_unicode_to_char(item, &size);
+    if (str == NULL)
+    {
+      return false;
+    }
+    return visitor.visit(str, size);
+  }
+
+  /*
+   * Passes fixed-width items of a buffer to the visitor.
+   */
+  static bool visit_packed_strings(Py_buffer& buffer, StringsVisitor& visitor,
+                                   Py_ssize_t packed_item_size)
+  {
+    Py_ssize_t item_size = buffer.itemsize;
+    const char* format = buffer.format == NULL ? "B" : buffer.format;
+    char format_type = format[strlen(format) - 1];
+
+    if (item_size == 1 &&
+        (format_type == 'B' || format_type == 'b' || format_type == 'c'))
+    {
+      // A buffer of bytes, like bytes or bytearray.
+      item_size = packed_item_size;
+    }
+    else if (format_type != 's')
+    {
+      PyErr_Format(PyExc_TypeError,
+                   "Buffer should contain fixed-width strings. Found format: %s",
+                   format);
+      return false;
+    }
+
+    if (item_size <= 0)
+    {
+      PyErr_SetString(PyExc_TypeError,
+                      "Expected a collection of str, or an array of "
+                      "fixed-width strings.");
+      return false;
+    }
+    if (buffer.len % item_size != 0)
+    {
+      PyErr_Format(PyExc_ValueError,
+                   "Size of the buffer should be a multiple of %zd.",
+                   item_size);
+      return false;
+    }
+
+    // Items are not null terminated, so each one is copied here first.
+    std::vector<char> item(item_size + 1);
+    const char* data = (const char*)buffer.buf;
+
+    for (Py_ssize_t offset = 0; offset < buffer.len; offset += item_size)
+    {
+      Py_ssize_t size = item_size;
+      while (size > 0 && data[offset + size - 1] == '\0')
+      {
+        size--;
+      }
+      memcpy(&item[0], data + offset, size);
+      item[size] = '\0';
+
+      if (!visitor.visit(&item[0], size))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool visit_strings(PyObject* strings, StringsVisitor& visitor,
+                     Py_ssize_t packed_item_size)
+  {
+    if (PyUnicode_Check(strings))
+    {
+      PyErr_SetString(PyExc_TypeError,
+                      "Expected a collection of str. Found a single str.");
+      return false;
+    }
+
+    if (PyList_Check(strings) || PyTuple_Check(strings))
+    {
+      // Items are borrowed references.
+      Py_ssize_t size = PySequence_Fast_GET_SIZE(strings);
+      PyObject** items = PySequence_Fast_ITEMS(strings);
+
+      for (Py_ssize_t i = 0; i < size; i++)
+      {
+        if (!visit_item(items[i], visitor))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    if (PyObject_CheckBuffer(strings))
+    {
+      Py_buffer buffer;
+      if (PyObject_GetBuffer(strings, &buffer,
+                             PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+      {
+        return false;
+      }
+
+      bool result = visit_packed_strings(buffer, visitor, packed_item_size);
+      PyBuffer_Release(&buffer);
+      return result;
+    }
+
+    // Any other iterable.
+    PyObject* iterator = PyObject_GetIter(strings);
+    if (iterator == NULL)
+    {
+      return false;
+    }
+    PyObjectHolder iterator_holder(iterator);
+
+    PyObject* item;
+    while ((item = PyIter_Next(iterator)) != NULL)
+    {
+      PyObjectHolder item_holder(item);
+      if (!visit_item(item, visitor))
+      {
+        return false;
+      }
+    }
+
+    return !PyErr_Occurred();
+  }
+
+  /*
+   * Adds each visited ID to a FileInfoCollection.
+   */
+  class FileInfoCollectionBuilder : public StringsVisitor
+  {
+  public:
+    FileInfoCollectionBuilder(libtocc::FileInfoCollection* collection)
+    {
+      this->collection = collection;
+    }
+
+    virtual bool visit(const char* str, Py_ssize_t size)
+    {
+      // FileInfo keeps a copy of the ID.
+      this->collection->add_file_info(libtocc::FileInfo(str));
+      return true;
+    }
+
+  private:
+    libtocc::FileInfoCollection* collection;
+  };
+
+  /*
+   * Adds each visited tag to a TagsCollection.
+   */
+  class TagsCollectionBuilder : public StringsVisitor
+  {
+  public:
+    TagsCollectionBuilder(libtocc::TagsCollection* collection)
+    {
+      this->collection = collection;
+    }
+
+    virtual bool visit(const char* str, Py_ssize_t size)
+    {
+      // TagsCollection keeps a copy of the tag.
+      this->collection->add_tag(str);
+      return true;
+    }
+
+  private:
+    libtocc::TagsCollection* collection;
+  };
+
+  /*
+   * Returns number of items of the collection, if it's known without
+   * iterating it. Otherwise, returns zero.
+   */
+  static Py_ssize_t strings_size_hint(PyObject* strings)
+  {
+    if (PyList_Check(strings) || PyTuple_Check(strings))
+    {
+      return PySequence_Fast_GET_SIZE(strings);
+    }
+    return 0;
+  }
+
   libtocc::FileInfoCollection* file_ids_to_info_collection(PyObject* ids_list)
   {
-    // Copying the list to a FileInfoCollection.
     libtocc::FileInfoCollection* collection =
-        new libtocc::FileInfoCollection(PyList_Size(ids_list));
+        new libtocc::FileInfoCollection(strings_size_hint(ids_list));
+    FileInfoCollectionBuilder builder(collection);
 
-    for (int i = 0; i < PyList_Size(ids_list); i++)
+    if (!visit_strings(ids_list, builder, FILE_ID_SIZE))
     {
-      PyObject* item = PyList_GetItem(ids_list, i);
-      PyObjectHolder item_holder(item);
-      libtocc::FileInfo file_info(python_unicode_to_char(item));
-      collection->add_file_info(file_info);
+      delete collection;
+      return NULL;
     }
 
     return collection;
@@ -77,15 +588,14 @@ namespace libtocc_python
 
   libtocc::TagsCollection* tags_list_to_collection(PyObject* tags_list)
   {
-    int tags_size = PyList_Size(tags_list);
-    libtocc::TagsCollection* tags_collection = new
-        libtocc::TagsCollection(tags_size);
+    libtocc::TagsCollection* tags_collection =
+        new libtocc::TagsCollection(strings_size_hint(tags_list));
+    TagsCollectionBuilder builder(tags_collection);
 
-    for (int i = 0; i < tags_size; i++)
+    if (!visit_strings(tags_list, builder, 0))
     {
-      PyObject* item = PyList_GetItem(tags_list, i);
-      PyObjectHolder item_holder(item);
-      tags_collection->add_tag(python_unicode_to_char(item));
+      delete tags_collection;
+      return NULL;
     }
 
     return tags_collection;
@@ -26,6 +26,7 @@ extern "C"
 }
 
 #include <libtocc/front_end/file_info.h>
+#include <libtocc/common/base_exception.h>
 
 
 namespace libtocc_python
@@ -56,25 +57,245 @@ namespace libtocc_python
   };
 
   /*
-   * Converts a PyUnicode object to a char*.
+   * Releases the GIL at construction time, and re-acquires it at
+   * destruction time. So exceptions thrown by libtocc can't leave the
+   * interpreter without the GIL.
+   *
+   * If a lock is specified, it will be acquired after the GIL is released,
+   * and released before the GIL is re-acquired. A lock should never be
+   * acquired while the GIL is held, or two threads may deadlock.
+   */
+  class GILReleaser
+  {
+  public:
+    /*
+     * @param lock: Lock to acquire while the GIL is released. Can be NULL.
+     */
+    GILReleaser(PyThread_type_lock lock);
+
+    ~GILReleaser();
+
+    /*
+     * Releases the lock and re-acquires the GIL before destruction time.
+     * Use it when the result of a libtocc call should be converted to
+     * Python objects in the same scope.
+     */
+    void restore();
+
+  private:
+    PyThreadState* thread_state;
+    PyThread_type_lock lock;
+  };
+
+  /*
+   * Acquires a lock at construction time, and releases it at destruction
+   * time. It should be used while the GIL is released (see GILReleaser),
+   * when only a part of the work needs the lock.
+   */
+  class LockHolder
+  {
+  public:
+    /*
+     * @param lock: Lock to acquire. Can be NULL.
+     */
+    LockHolder(PyThread_type_lock lock);
+
+    ~LockHolder();
+
+  private:
+    // Holder is not copyable.
+    LockHolder(const LockHolder&);
+    LockHolder& operator=(const LockHolder&);
+
+    PyThread_type_lock lock;
+  };
+
+  /*
+   * Sets the Python error from the specified libtocc exception.
+   * Should be called while the GIL is held.
+   */
+  void set_libtocc_error(libtocc::BaseException& error);
+
+  /*
+   * Keeps copies of strings, until it's destroyed.
+   *
+   * Memory is allocated in blocks, and all of the strings of a block are
+   * freed together. Use it when strings should outlive their Python
+   * objects, e.g. while the GIL is released, and reserve the total size
+   * up front so the whole conversion costs a single allocation.
+   */
+  class StringArena
+  {
+  public:
+    StringArena();
+
+    ~StringArena();
+
+    /*
+     * Makes sure the next allocations of `size' bytes in total don't
+     * need a new block. (Size of the pointer arrays should be included,
+     * and if there's any, they should be allocated first.)
+     */
+    void reserve(size_t size);
+
+    /*
+     * Allocates memory from the arena. The memory is aligned for
+     * pointers, and is valid until the arena is destroyed.
+     */
+    void* allocate(size_t size);
+
+    /*
+     * Copies the specified string (plus a null terminator) to the arena.
+     */
+    const char* copy(const char* str, size_t size);
+
+  private:
+    struct Block
+    {
+      Block* previous;
+      size_t capacity;
+      size_t used;
+    };
+
+    // Arena is not copyable.
+    StringArena(const StringArena&);
+    StringArena& operator=(const StringArena&);
+
+    Block* current_block;
+  };
+
+  /*
+   * Returns the UTF-8 representation of a PyUnicode object.
+   *
+   * It doesn't allocate: the returned pointer points to the UTF-8 buffer
+   * cached inside the object, and it's valid as long as the object is
+   * alive. Copy it (e.g. to a StringArena) if it should be used after
+   * the object is released, or while the GIL is released and something
+   * else may release the object.
    *
    * If any error happens, it sets the PyErr and returns NULL.
    */
-  char* python_unicode_to_char(PyObject* unicode_object);
+  const char* python_unicode_to_char(PyObject* unicode_object);
+
+  /*
+   * Same as above, but also returns size of the string in bytes.
+   */
+  const char* python_unicode_to_char(PyObject* unicode_object,
+                                     Py_ssize_t* size);
+
+  /*
+   * Unpacks arguments of a METH_FASTCALL | METH_KEYWORDS method (or a
+   * vectorcall), by matching them with the parameters names. It doesn't
+   * create any objects, nor parses a format string.
+   *
+   * @param function_name: Name of the function, used in error messages.
+   * @param args: Positional arguments, followed by keyword arguments'
+   *   values.
+   * @param nargs: Number of the positional arguments.
+   * @param kwnames: Tuple of keyword arguments' names, or NULL.
+   * @param kwlist: Names of the parameters, terminated by NULL.
+   * @param required: Number of the required parameters. They should be
+   *   at the start of the `kwlist'.
+   * @param out_values: An array of size of `kwlist'. Each item is set to
+   *   a borrowed reference of its argument, or NULL if not passed.
+   *
+   * @return: false if arguments don't match the parameters. It sets the
+   *   Python Error.
+   */
+  bool unpack_fastcall_args(const char* function_name,
+                            PyObject* const* args, Py_ssize_t nargs,
+                            PyObject* kwnames,
+                            const char* const* kwlist, int required,
+                            PyObject** out_values);
+
+  /*
+   * Same as `unpack_fastcall_args', for methods that receive their
+   * arguments as a tuple and a dict, like __init__.
+   *
+   * @param args: Tuple of the positional arguments.
+   * @param kwargs: Dict of the keyword arguments, or NULL.
+   */
+  bool unpack_tuple_args(const char* function_name,
+                         PyObject* args, PyObject* kwargs,
+                         const char* const* kwlist, int required,
+                         PyObject** out_values);
+
+  /*
+   * Converts an argument to Py_ssize_t.
+   *
+   * @return: false if it's not an integer. It sets the Python Error.
+   */
+  bool python_to_ssize_t(PyObject* object, Py_ssize_t* out_value);
 
   /*
-   * Converts a Python's list of str (list of file IDs) to a collection
-   * of File Infos.
+   * Size of the libtocc file IDs. It's used to read IDs from bytes
+   * objects, that IDs are packed in without any separators.
+   */
+  const Py_ssize_t FILE_ID_SIZE = 7;
+
+  /*
+   * Receives items of a bulk argument, one by one.
+   * See `visit_strings'.
+   */
+  class StringsVisitor
+  {
+  public:
+    virtual ~StringsVisitor();
+
+    /*
+     * Called for each string item.
+     * `str' is null terminated, and is valid only during the call.
+     *
+     * @return: false if any errors happen. It should set the Python Error.
+     */
+    virtual bool visit(const char* str, Py_ssize_t size) = 0;
+
+    /*
+     * Called for each item that is not a str.
+     * Default implementation sets a TypeError and returns false.
+     */
+    virtual bool visit_object(PyObject* item);
+  };
+
+  /*
+   * Calls the visitor for each item of a bulk argument.
+   *
+   * @param strings: Can be
+   *   - a list or a tuple, read directly through the fast sequence protocol,
+   *   - any other iterable (set, generator, ...), read item by item without
+   *     copying it to a list first,
+   *   - a buffer of fixed-width strings, e.g. bytes or a numpy `S' array.
+   *     Items are read directly from the buffer, and no Python objects
+   *     are created for them. Trailing null bytes of each item are ignored.
+   *   A single str is not accepted.
+   * @param packed_item_size: Width of the items, if `strings' is a buffer
+   *   of single bytes (like bytes or bytearray). If it's zero, such buffers
+   *   are not accepted.
+   *
+   * @return: false if any errors happen. It sets the Python Error.
+   */
+  bool visit_strings(PyObject* strings, StringsVisitor& visitor,
+                     Py_ssize_t packed_item_size);
+
+  /*
+   * Converts a collection of str (file IDs) to a collection of File Infos.
    * Each element of the collection have only its ID set.
+   * File IDs can be passed in any of the forms `visit_strings' accepts.
    *
    * Note that you should delete the return pointer when you finished with it.
+   *
+   * @return: NULL if any errors happen. It sets the Python Error.
    */
   libtocc::FileInfoCollection* file_ids_to_info_collection(PyObject* ids_list);
 
   /*
-   * Converts a Python's list of str (list of Tags) to a collection of Tags.
+   * Converts a collection of str (Tags) to a collection of Tags.
+   * Tags can be passed in any of the forms `visit_strings' accepts, except
+   * bytes objects (which can't show where a tag ends).
    *
    * Note that you should delete the return pointer when you finished with it.
+   *
+   * @return: NULL if any errors happen. It sets the Python Error.
    */
   libtocc::TagsCollection* tags_list_to_collection(PyObject* tags_list);
 }
@@ -0,0 +1,442 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "worker_pool.h"
+#include "utilities.h"
+#include "file_transfer.h"
+
+#include <libtocc/common/base_exception.h>
+
+#include <errno.h>
+#include <exception>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * The pool that runs all of the async tasks. It's created on the first
+   * use, and stopped when the interpreter exits.
+   */
+  static WorkerPool* worker_pool = NULL;
+
+  // asyncio.get_running_loop
+  static PyObject* get_running_loop_function = NULL;
+
+  // The C function below, as a Python object.
+  static PyObject* complete_future_function = NULL;
+
+  /*
+   * Sets the result (or the exception) of a future, unless it's
+   * cancelled. It's called by the event loop, in its own thread.
+   *
+   * Arguments are (future, value, is_error).
+   */
+  static PyObject* complete_future(PyObject* module, PyObject* const* args,
+                                   Py_ssize_t nargs)
+  {
+    if (nargs != 3)
+    {
+      PyErr_SetString(PyExc_TypeError, "_complete_future takes 3 arguments.");
+      return NULL;
+    }
+    PyObject* future = args[0];
+
+    // Awaiting side may have cancelled the future in the meanwhile.
+    PyObject* cancelled = PyObject_CallMethod(future, "cancelled", NULL);
+    if (cancelled == NULL)
+    {
+      return NULL;
+    }
+    int is_cancelled = PyObject_IsTrue(cancelled);
+    Py_DECREF(cancelled);
+    if (is_cancelled < 0)
+    {
+      return NULL;
+    }
+    if (is_cancelled)
+    {
+      Py_RETURN_NONE;
+    }
+
+    const char* method = args[2] == Py_True ? "set_exception" : "set_result";
+    return PyObject_CallMethod(future, method, "O", args[1]);
+  }
+
+  static PyMethodDef complete_future_def =
+  {
+    "_complete_future", (PyCFunction)complete_future, METH_FASTCALL, NULL
+  };
+
+  /*
+   * Stops the worker pool. Registered in `atexit', so no worker tries to
+   * take the GIL while the interpreter is finalizing.
+   */
+  static PyObject* stop_worker_pool(PyObject* module, PyObject* unused)
+  {
+    if (worker_pool == NULL)
+    {
+      Py_RETURN_NONE;
+    }
+
+    std::vector<AsyncTask*> pending_tasks;
+    // Running tasks need the GIL to complete.
+    Py_BEGIN_ALLOW_THREADS
+    pending_tasks = worker_pool->stop();
+    Py_END_ALLOW_THREADS
+
+    // Their futures will never be completed, since the loop is gone.
+    for (size_t i = 0; i < pending_tasks.size(); i++)
+    {
+      delete pending_tasks[i];
+    }
+
+    Py_RETURN_NONE;
+  }
+
+  static PyMethodDef stop_worker_pool_def =
+  {
+    "_stop_worker_pool", (PyCFunction)stop_worker_pool, METH_NOARGS, NULL
+  };
+
+  /*
+   * Imports what async tasks need, and starts the worker pool.
+   *
+   * @return: false if any errors happen. It sets the Python Error.
+   */
+  static bool init_worker_pool()
+  {
+    if (worker_pool != NULL)
+    {
+      return true;
+    }
+
+    PyObject* asyncio_module = PyImport_ImportModule("asyncio");
+    if (asyncio_module == NULL)
+    {
+      return false;
+    }
+    get_running_loop_function =
+        PyObject_GetAttrString(asyncio_module, "get_running_loop");
+    Py_DECREF(asyncio_module);
+    if (get_running_loop_function == NULL)
+    {
+      return false;
+    }
+
+    complete_future_function = PyCFunction_New(&complete_future_def, NULL);
+    if (complete_future_function == NULL)
+    {
+      return false;
+    }
+
+    PyObject* stop_function = PyCFunction_New(&stop_worker_pool_def, NULL);
+    if (stop_function == NULL)
+    {
+      return false;
+    }
+    PyObjectHolder stop_function_holder(stop_function);
+    PyObject* atexit_module = PyImport_ImportModule("atexit");
+    if (atexit_module == NULL)
+    {
+      return false;
+    }
+    PyObjectHolder atexit_module_holder(atexit_module);
+    PyObject* registered =
+        PyObject_CallMethod(atexit_module, "register", "O", stop_function);
+    if (registered == NULL)
+    {
+      return false;
+    }
+    Py_DECREF(registered);
+
+    // libtocc calls of a Manager are serialized by its lock, so more
+    // threads only help when many Managers are used.
+    unsigned int threads_count = std::thread::hardware_concurrency();
+    if (threads_count < 2)
+    {
+      threads_count = 2;
+    }
+    if (threads_count > 8)
+    {
+      threads_count = 8;
+    }
+    worker_pool = new WorkerPool(threads_count);
+
+    return true;
+  }
+
+  /*
+   * Returns a new reference to the running event loop. It sets the
+   * Python Error (RuntimeError) if there's no running loop.
+   */
+  static PyObject* get_running_loop()
+  {
+    if (!init_worker_pool())
+    {
+      return NULL;
+    }
+
+    return PyObject_CallObject(get_running_loop_function, NULL);
+  }
+
+  /*
+   * Takes the current Python Error, and returns it as an exception
+   * object (new reference).
+   */
+  static PyObject* fetch_python_error()
+  {
+    PyObject* type;
+    PyObject* value;
+    PyObject* traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+
+    if (value != NULL && traceback != NULL)
+    {
+      PyException_SetTraceback(value, traceback);
+    }
+    Py_XDECREF(type);
+    Py_XDECREF(traceback);
+
+    if (value == NULL)
+    {
+      Py_INCREF(Py_None);
+      value = Py_None;
+    }
+    return value;
+  }
+
+  AsyncTask::AsyncTask()
+  {
+    this->loop = NULL;
+    this->future = NULL;
+    this->failed = false;
+    this->error_number = 0;
+  }
+
+  AsyncTask::~AsyncTask()
+  {
+    Py_XDECREF(this->loop);
+    Py_XDECREF(this->future);
+  }
+
+  void AsyncTask::finish()
+  {
+  }
+
+  void AsyncTask::execute()
+  {
+    try
+    {
+      run();
+    }
+    catch (libtocc::BaseException& error)
+    {
+      this->failed = true;
+      this->error_message = error.what();
+    }
+    catch (FileTransferError& error)
+    {
+      this->failed = true;
+      this->error_message = error.what();
+      this->error_number = error.get_error_number();
+      this->error_path = error.get_path();
+    }
+    catch (std::exception& error)
+    {
+      this->failed = true;
+      this->error_message = error.what();
+    }
+  }
+
+  void AsyncTask::complete()
+  {
+    finish();
+
+    PyObject* value;
+    bool is_error = this->failed;
+    if (this->failed && this->error_number != 0)
+    {
+      // Same as the synchronous methods raise for a FileTransferError.
+      errno = this->error_number;
+      PyErr_SetFromErrnoWithFilename(PyExc_OSError, this->error_path.c_str());
+      value = NULL;
+    }
+    else if (this->failed)
+    {
+      // Same as set_libtocc_error.
+      value = PyObject_CallFunction(PyExc_RuntimeError, "s",
+                                    this->error_message.c_str());
+    }
+    else
+    {
+      value = get_result();
+    }
+    if (value == NULL)
+    {
+      is_error = true;
+      value = fetch_python_error();
+    }
+
+    PyObject* scheduled =
+        PyObject_CallMethod(this->loop, "call_soon_threadsafe", "OOOO",
+                            complete_future_function, this->future, value,
+                            is_error ? Py_True : Py_False);
+    if (scheduled == NULL)
+    {
+      // Loop is closed, so no one is waiting for the future.
+      PyErr_Clear();
+    }
+    Py_XDECREF(scheduled);
+    Py_DECREF(value);
+  }
+
+  WorkerPool::WorkerPool(unsigned int threads_count)
+  {
+    this->stopped = false;
+
+    for (unsigned int i = 0; i < threads_count; i++)
+    {
+      this->threads.push_back(std::thread(&WorkerPool::work, this));
+    }
+  }
+
+  bool WorkerPool::submit(AsyncTask* task)
+  {
+    {
+      std::lock_guard<std::mutex> queue_lock(this->queue_mutex);
+      if (this->stopped)
+      {
+        return false;
+      }
+      this->queue.push_back(task);
+    }
+
+    this->queue_condition.notify_one();
+    return true;
+  }
+
+  std::vector<AsyncTask*> WorkerPool::stop()
+  {
+    std::vector<AsyncTask*> pending_tasks;
+    {
+      std::lock_guard<std::mutex> queue_lock(this->queue_mutex);
+      this->stopped = true;
+      pending_tasks.assign(this->queue.begin(), this->queue.end());
+      this->queue.clear();
+    }
+    this->queue_condition.notify_all();
+
+    for (size_t i = 0; i < this->threads.size(); i++)
+    {
+      if (this->threads[i].joinable())
+      {
+        this->threads[i].join();
+      }
+    }
+
+    return pending_tasks;
+  }
+
+  void WorkerPool::work()
+  {
+    while (true)
+    {
+      AsyncTask* task;
+      {
+        std::unique_lock<std::mutex> queue_lock(this->queue_mutex);
+        while (!this->stopped && this->queue.empty())
+        {
+          this->queue_condition.wait(queue_lock);
+        }
+        if (this->stopped)
+        {
+          return;
+        }
+        task = this->queue.front();
+        this->queue.pop_front();
+      }
+
+      task->execute();
+
+      PyGILState_STATE gil_state = PyGILState_Ensure();
+      task->complete();
+      delete task;
+      PyGILState_Release(gil_state);
+    }
+  }
+
+  PyObject* submit_async_task(AsyncTask* task)
+  {
+    PyObject* loop = get_running_loop();
+    if (loop == NULL)
+    {
+      delete task;
+      return NULL;
+    }
+    task->loop = loop;
+
+    task->future = PyObject_CallMethod(loop, "create_future", NULL);
+    if (task->future == NULL)
+    {
+      delete task;
+      return NULL;
+    }
+    PyObject* future = task->future;
+    Py_INCREF(future);
+
+    if (!worker_pool->submit(task))
+    {
+      delete task;
+      Py_DECREF(future);
+      PyErr_SetString(PyExc_RuntimeError, "Worker pool is stopped.");
+      return NULL;
+    }
+
+    return future;
+  }
+
+  PyObject* create_completed_future(PyObject* result)
+  {
+    PyObject* loop = get_running_loop();
+    if (loop == NULL)
+    {
+      return NULL;
+    }
+    PyObjectHolder loop_holder(loop);
+
+    PyObject* future = PyObject_CallMethod(loop, "create_future", NULL);
+    if (future == NULL)
+    {
+      return NULL;
+    }
+
+    PyObject* set_result = PyObject_CallMethod(future, "set_result", "O", result);
+    if (set_result == NULL)
+    {
+      Py_DECREF(future);
+      return NULL;
+    }
+    Py_DECREF(set_result);
+
+    return future;
+  }
+
+}
@@ -0,0 +1,167 @@
+/*
+ * This file is part of libtocc-python. A Python wrapper for libtocc.
+ * (see <http://www.github.com/aidin36/libtocc-python>)
+ * Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+ *
+ * libtocc-python is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libtocc-python is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTOCC_PYTHON_WORKER_POOL_H_INCLUDED
+#define LIBTOCC_PYTHON_WORKER_POOL_H_INCLUDED
+
+extern "C"
+{
+#include <Python.h>
+}
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace libtocc_python
+{
+
+  /*
+   * A job that runs on the worker pool, and completes an asyncio future
+   * with its result.
+   *
+   * Tasks are created and destroyed while the GIL is held. Only `run'
+   * is called without the GIL.
+   */
+  class AsyncTask
+  {
+  public:
+    AsyncTask();
+
+    virtual ~AsyncTask();
+
+    /*
+     * Does the work in a worker thread, without the GIL. It shouldn't
+     * touch any Python objects. If it throws an exception, the future
+     * will be completed with a RuntimeError, or an OSError if it's a
+     * FileTransferError.
+     */
+    virtual void run() = 0;
+
+    /*
+     * Called with the GIL held after `run', even if it failed. Things
+     * that need the GIL, like updating caches, should be done here.
+     */
+    virtual void finish();
+
+    /*
+     * Called with the GIL held if `run' succeeded. Returns a new
+     * reference to the result of the future, or NULL if any errors
+     * happen (then the future will be completed with the Python Error).
+     */
+    virtual PyObject* get_result() = 0;
+
+  private:
+    friend class WorkerPool;
+    friend PyObject* submit_async_task(AsyncTask* task);
+
+    // Task is not copyable.
+    AsyncTask(const AsyncTask&);
+    AsyncTask& operator=(const AsyncTask&);
+
+    /*
+     * Calls `run', and keeps its error. Called without the GIL.
+     */
+    void execute();
+
+    /*
+     * Schedules setting the result (or the exception) of the future on
+     * its event loop. Called with the GIL held.
+     */
+    void complete();
+
+    PyObject* loop;
+    PyObject* future;
+    bool failed;
+    std::string error_message;
+    // Set if it failed with a FileTransferError, so an OSError is raised.
+    int error_number;
+    std::string error_path;
+  };
+
+  /*
+   * Runs AsyncTasks on native threads. Since they're not Python threads,
+   * thousands of tasks can be waiting without a Python thread for each.
+   */
+  class WorkerPool
+  {
+  public:
+    /*
+     * @param threads_count: Number of the worker threads.
+     */
+    WorkerPool(unsigned int threads_count);
+
+    /*
+     * Adds the task to the queue. The pool takes its ownership.
+     *
+     * @return: false if the pool is stopped. Then the task is not taken.
+     */
+    bool submit(AsyncTask* task);
+
+    /*
+     * Waits for the running tasks and stops the threads. Tasks still in
+     * the queue are returned, so the caller can delete them with the GIL
+     * held. It should be called without the GIL.
+     */
+    std::vector<AsyncTask*> stop();
+
+  private:
+    // Pool is not copyable.
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void work();
+
+    std::vector<std::thread> threads;
+    std::deque<AsyncTask*> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    bool stopped;
+  };
+
+  /*
+   * Creates a future on the running event loop, and runs the task on
+   * the shared worker pool to complete it. It takes the ownership of the
+   * task, even if it fails.
+   *
+   * It should be called from a coroutine (or a callback) of the loop.
+   *
+   * @return: New reference to the future, or NULL if any errors happen.
+   *   It sets the Python Error.
+   */
+  PyObject* submit_async_task(AsyncTask* task);
+
+  /*
+   * Creates a future on the running event loop, that its result is
+   * already set. Used when the result is known without any blocking
+   * call (e.g. it's cached.)
+   *
+   * @param result: The future takes a new reference to it.
+   *
+   * @return: New reference to the future, or NULL if any errors happen.
+   */
+  PyObject* create_completed_future(PyObject* result);
+
+}
+
+#endif /* LIBTOCC_PYTHON_WORKER_POOL_H_INCLUDED */
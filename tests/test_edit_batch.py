@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+#
+# This file is part of libtocc-python. A Python wrapper for libtocc.
+# (see <http://www.github.com/aidin36/libtocc-python>)
+# Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+#
+# libtocc-python is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# libtocc-python is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Checks how the edits of a Manager batch, or of apply_tag_changes, are
+merged and grouped (see src/edit_batch.cpp): the last edit of a tag or
+title wins, and files with exactly the same edits share the bulk libtocc
+calls.
+
+Usage: test_edit_batch.py [unittest options]
+The built `manager' and `file_info' modules should be on PYTHONPATH.
+"""
+
+import os
+import shutil
+import tempfile
+import threading
+import unittest
+
+import file_info  # noqa: F401 (manager needs its C API.)
+import manager
+
+
+class ManagerEditsTest(unittest.TestCase):
+    """
+    Imports a few files, with a title and a tag, to edit.
+    """
+
+    def setUp(self):
+        self.base_path = tempfile.mkdtemp(prefix="tocc-edit-batch-")
+        self.manager = manager.Manager(self.base_path)
+        self.manager.initialize()
+
+        source = os.path.join(self.base_path, "source")
+        with open(source, "wb") as source_file:
+            source_file.write(b"data")
+        self.file_ids = [
+            self.manager.import_file(source, title="old", tags=["base"]).id
+            for _ in range(4)]
+
+    def tearDown(self):
+        shutil.rmtree(self.base_path, ignore_errors=True)
+
+    def tags_of(self, file_id):
+        return set(self.manager.get_file_info(file_id).tags)
+
+    def title_of(self, file_id):
+        return self.manager.get_file_info(file_id).title
+
+
+class EditBatchTest(ManagerEditsTest):
+
+    def test_edits_are_queued(self):
+        with self.manager.batch():
+            self.manager.assign_tags(self.file_ids, ["a"])
+            self.manager.set_title(self.file_ids, "new")
+            self.assertEqual(self.tags_of(self.file_ids[0]), {"base"})
+            self.assertEqual(self.title_of(self.file_ids[0]), "old")
+
+        self.assertEqual(self.tags_of(self.file_ids[0]), {"base", "a"})
+        self.assertEqual(self.title_of(self.file_ids[0]), "new")
+
+    def test_last_tag_edit_wins(self):
+        with self.manager.batch() as batch:
+            self.manager.assign_tags(self.file_ids[:2], ["a"])
+            self.manager.unassign_tags(self.file_ids[:1], ["a"])
+            self.manager.unassign_tags(self.file_ids[2:], ["base"])
+            self.manager.assign_tags(self.file_ids[3:], ["base"])
+
+        self.assertEqual(batch.queued, 6)
+        self.assertEqual(batch.coalesced, 2)
+        self.assertEqual(self.tags_of(self.file_ids[0]), {"base"})
+        self.assertEqual(self.tags_of(self.file_ids[1]), {"base", "a"})
+        self.assertEqual(self.tags_of(self.file_ids[2]), set())
+        self.assertEqual(self.tags_of(self.file_ids[3]), {"base"})
+
+    def test_last_title_wins(self):
+        with self.manager.batch() as batch:
+            self.manager.set_title(self.file_ids, "first")
+            self.manager.set_title(self.file_ids[0], "second")
+
+        self.assertEqual(batch.coalesced, 1)
+        self.assertEqual(self.title_of(self.file_ids[0]), "second")
+        self.assertEqual(self.title_of(self.file_ids[1]), "first")
+
+    def test_files_with_same_edits_are_grouped(self):
+        with self.manager.batch() as batch:
+            # Same edits, in a different order: one assign call.
+            self.manager.assign_tags(self.file_ids[:2], ["a", "b"])
+            self.manager.assign_tags(self.file_ids[2:3], ["b"])
+            self.manager.assign_tags(self.file_ids[2:3], ["a"])
+            # Another group, that needs an assign and an unassign call.
+            self.manager.assign_tags(self.file_ids[3:], ["a"])
+            self.manager.unassign_tags(self.file_ids[3:], ["base"])
+
+        self.assertEqual(batch.calls, 3)
+        for file_id in self.file_ids[:3]:
+            self.assertEqual(self.tags_of(file_id), {"base", "a", "b"})
+        self.assertEqual(self.tags_of(self.file_ids[3]), {"a"})
+
+    def test_titles_are_grouped(self):
+        with self.manager.batch() as batch:
+            self.manager.set_title(self.file_ids[0], "x")
+            self.manager.set_title(self.file_ids[1], "y")
+            self.manager.set_title(self.file_ids[2:], "x")
+
+        self.assertEqual(batch.calls, 2)
+        self.assertEqual([self.title_of(file_id) for file_id in self.file_ids],
+                         ["x", "y", "x", "x"])
+
+    def test_failed_block_discards_edits(self):
+        with self.assertRaises(KeyError):
+            with self.manager.batch():
+                self.manager.assign_tags(self.file_ids, ["a"])
+                raise KeyError("stop")
+
+        self.assertEqual(self.tags_of(self.file_ids[0]), {"base"})
+
+    def test_batches_are_per_thread(self):
+        other_thread_tags = []
+
+        def other_thread():
+            # Not queued in the batch of the main thread.
+            self.manager.assign_tags(self.file_ids[:1], ["other"])
+            other_thread_tags.append(self.tags_of(self.file_ids[0]))
+
+        with self.manager.batch():
+            self.manager.assign_tags(self.file_ids[:1], ["a"])
+            thread = threading.Thread(target=other_thread)
+            thread.start()
+            thread.join()
+
+        self.assertEqual(other_thread_tags, [{"base", "other"}])
+        self.assertEqual(self.tags_of(self.file_ids[0]), {"base", "other", "a"})
+
+
+class ApplyTagChangesTest(ManagerEditsTest):
+    """
+    apply_tag_changes builds a batch of its own, so it follows the same
+    rules.
+    """
+
+    def test_changes(self):
+        self.manager.apply_tag_changes({
+            self.file_ids[0]: (["a", "b"], None),
+            self.file_ids[1]: (None, ["base"]),
+            self.file_ids[2]: (["a"], ["base"]),
+        })
+
+        self.assertEqual(self.tags_of(self.file_ids[0]), {"base", "a", "b"})
+        self.assertEqual(self.tags_of(self.file_ids[1]), set())
+        self.assertEqual(self.tags_of(self.file_ids[2]), {"a"})
+        self.assertEqual(self.tags_of(self.file_ids[3]), {"base"})
+
+    def test_tag_in_both_is_unassigned(self):
+        self.manager.apply_tag_changes({
+            self.file_ids[0]: (["a", "base"], ["base", "a"]),
+        })
+
+        self.assertEqual(self.tags_of(self.file_ids[0]), set())
+
+    def test_changes_are_grouped(self):
+        changes = dict((file_id, (["a"], ["base"])) for file_id in self.file_ids)
+        changes[self.file_ids[0]] = (["b"], None)
+
+        with self.manager.batch() as batch:
+            self.manager.apply_tag_changes(changes)
+
+        # One group of an assign and an unassign, and one of an assign.
+        self.assertEqual(batch.calls, 3)
+        self.assertEqual(self.tags_of(self.file_ids[0]), {"base", "b"})
+        self.assertEqual(self.tags_of(self.file_ids[1]), {"a"})
+
+    def test_changes_after_queued_edits_win(self):
+        with self.manager.batch() as batch:
+            self.manager.assign_tags(self.file_ids[:1], ["a"])
+            self.manager.apply_tag_changes({self.file_ids[0]: (None, ["a"])})
+
+        self.assertEqual(batch.coalesced, 1)
+        self.assertEqual(self.tags_of(self.file_ids[0]), {"base"})
+
+    def test_invalid_changes(self):
+        with self.assertRaises(TypeError):
+            self.manager.apply_tag_changes({self.file_ids[0]: ["a"]})
+        with self.assertRaises(TypeError):
+            self.manager.apply_tag_changes([self.file_ids[0]])
+        with self.assertRaises(TypeError):
+            self.manager.set_titles([(self.file_ids[0], "title")])
+
+
+if __name__ == "__main__":
+    unittest.main()
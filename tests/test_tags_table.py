@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+#
+# This file is part of libtocc-python. A Python wrapper for libtocc.
+# (see <http://www.github.com/aidin36/libtocc-python>)
+# Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+#
+# libtocc-python is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# libtocc-python is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Checks that the tags table of a Manager with track_tags (see
+src/tags_table.cpp) matches the database after each kind of change.
+
+Each change is made through a Manager with track_tags, then its
+statistics (read from the table) are compared with the statistics of
+another Manager on the same base path, which queries the database.
+
+Usage: test_tags_table.py [unittest options]
+The built `manager' and `file_info' modules should be on PYTHONPATH.
+"""
+
+import os
+import shutil
+import tempfile
+import unittest
+
+import file_info  # noqa: F401 (manager needs its C API.)
+import manager
+
+
+class TagsTableTest(unittest.TestCase):
+
+    def setUp(self):
+        self.base_path = tempfile.mkdtemp(prefix="tocc-tags-table-")
+        self.tracked = manager.Manager(self.base_path, track_tags=True)
+        self.tracked.initialize()
+        self.database = manager.Manager(self.base_path)
+
+        source = os.path.join(self.base_path, "source")
+        with open(source, "wb") as source_file:
+            source_file.write(b"data")
+        self.source = source
+        self.file_ids = [self.tracked.import_file(source).id
+                         for _ in range(3)]
+
+        # Seeds the table, so the changes below update it.
+        self.assertEqual(self.tracked.get_tags_statistics(), {})
+
+    def tearDown(self):
+        shutil.rmtree(self.base_path, ignore_errors=True)
+
+    def assert_statistics(self, expected):
+        self.assertEqual(self.database.get_tags_statistics(), expected)
+        self.assertEqual(self.tracked.get_tags_statistics(), expected)
+
+    def test_assign(self):
+        self.tracked.assign_tags(self.file_ids[:2], ["a"])
+        self.assert_statistics({"a": 2})
+
+        # Files that had the tag before aren't counted again.
+        self.tracked.assign_tags(self.file_ids, ["a", "b"])
+        self.assert_statistics({"a": 3, "b": 3})
+
+    def test_assign_repeated_tag(self):
+        self.tracked.assign_tags(self.file_ids[:1], ["a"])
+        self.tracked.assign_tags(self.file_ids, ["a", "a", "b", "b"])
+        self.assert_statistics({"a": 3, "b": 3})
+
+    def test_unassign(self):
+        self.tracked.assign_tags(self.file_ids, ["a", "b"])
+        self.tracked.unassign_tags(self.file_ids[:2], ["a", "a", "c"])
+        self.assert_statistics({"a": 1, "b": 3})
+
+        # Tags without any files are left out.
+        self.tracked.unassign_tags(self.file_ids, ["a", "b"])
+        self.assert_statistics({})
+
+    def test_import_repeated_tag(self):
+        self.tracked.import_file(self.source, tags=["x", "x", "y"])
+        self.assert_statistics({"x": 1, "y": 1})
+
+    def test_remove(self):
+        self.tracked.assign_tags(self.file_ids, ["a"])
+        self.tracked.assign_tags(self.file_ids[:1], ["b"])
+        self.tracked.remove_file(self.file_ids[0])
+        self.assert_statistics({"a": 2})
+
+        self.tracked.remove_files(self.file_ids[1:])
+        self.assert_statistics({})
+
+    def test_apply_tag_changes(self):
+        self.tracked.apply_tag_changes({
+            self.file_ids[0]: (["a", "a", "b"], None),
+            self.file_ids[1]: (["a"], ["b"]),
+            self.file_ids[2]: (["b"], ["b"]),
+        })
+        self.assert_statistics({"a": 2, "b": 1})
+
+    def test_batch(self):
+        with self.tracked.batch():
+            self.tracked.assign_tags(self.file_ids, ["a", "a"])
+            self.tracked.unassign_tags(self.file_ids[:1], ["a"])
+            self.tracked.assign_tags(self.file_ids[:1], ["b"])
+        self.assert_statistics({"a": 2, "b": 1})
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# This file is part of libtocc-python. A Python wrapper for libtocc.
+# (see <http://www.github.com/aidin36/libtocc-python>)
+# Copyright (C) 2014, Aidin Gharibnavaz <aidin@t-o-c-c.com>
+#
+# libtocc-python is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# libtocc-python is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with libtocc-python.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Measures import and assign_tags throughput with different numbers of
+threads, each thread using its own Manager.
+
+Manager calls release the GIL while libtocc works, so throughput should
+go up with the number of threads (as long as the disk keeps up).
+
+Usage: threaded_throughput.py [--threads 1,2,4,8] [--operations 2000]
+The built `manager' and `file_info' modules should be on PYTHONPATH.
+"""
+
+import argparse
+import os
+import shutil
+import sys
+import tempfile
+import threading
+import time
+
+import file_info  # noqa: F401 (manager needs its C API.)
+import manager
+
+
+def run_threads(thread_count, operations, work):
+    """
+    Runs `work(thread_index, operations_per_thread)' in the specified
+    number of threads, and returns operations per second.
+    """
+    per_thread = operations // thread_count
+    barrier = threading.Barrier(thread_count + 1)
+    errors = []
+
+    def target(thread_index):
+        barrier.wait()
+        try:
+            work(thread_index, per_thread)
+        except Exception as error:
+            errors.append(error)
+
+    threads = [threading.Thread(target=target, args=(i,))
+               for i in range(thread_count)]
+    for thread in threads:
+        thread.start()
+    barrier.wait()
+    start = time.perf_counter()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    if errors:
+        raise errors[0]
+    return per_thread * thread_count / elapsed
+
+
+def measure(thread_count, operations, file_size):
+    base_paths = [tempfile.mkdtemp(prefix="tocc-throughput-")
+                  for _ in range(thread_count)]
+    try:
+        managers = []
+        sources = []
+        for base_path in base_paths:
+            tocc_manager = manager.Manager(base_path)
+            tocc_manager.initialize()
+            managers.append(tocc_manager)
+            source = os.path.join(base_path, "source")
+            with open(source, "wb") as source_file:
+                source_file.write(os.urandom(file_size))
+            sources.append(source)
+
+        imported = [[] for _ in range(thread_count)]
+
+        def import_work(thread_index, count):
+            tocc_manager = managers[thread_index]
+            source = sources[thread_index]
+            for _ in range(count):
+                imported[thread_index].append(
+                    tocc_manager.import_file(source).id)
+
+        def tag_work(thread_index, count):
+            tocc_manager = managers[thread_index]
+            file_ids = imported[thread_index]
+            for i in range(count):
+                tocc_manager.assign_tags([file_ids[i % len(file_ids)]],
+                                         ["tag%d" % (i % 16)])
+
+        return (run_threads(thread_count, operations, import_work),
+                run_threads(thread_count, operations, tag_work))
+    finally:
+        for base_path in base_paths:
+            shutil.rmtree(base_path, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--threads", default="1,2,4,8",
+                        help="Comma separated thread counts.")
+    parser.add_argument("--operations", type=int, default=2000,
+                        help="Total operations of each kind per run.")
+    parser.add_argument("--file-size", type=int, default=64 * 1024,
+                        help="Size of the imported file, in bytes.")
+    args = parser.parse_args()
+
+    thread_counts = [int(count) for count in args.threads.split(",")]
+    print("%8s %14s %14s %10s %10s" %
+          ("threads", "imports/s", "assigns/s", "import x", "assign x"))
+    baseline = None
+    for thread_count in thread_counts:
+        result = measure(thread_count, args.operations, args.file_size)
+        if baseline is None:
+            baseline = result
+        print("%8d %14.0f %14.0f %10.2f %10.2f" %
+              (thread_count, result[0], result[1],
+               result[0] / baseline[0], result[1] / baseline[1]))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())